@@ -38,7 +38,7 @@ namespace element
         {
         }
 
-        FloatNode::FloatNode(float value, const Location& coords) : Node(N_Float, coords), value(value)
+        FloatNode::FloatNode(double value, const Location& coords) : Node(N_Float, coords), value(value)
         {
         }
 
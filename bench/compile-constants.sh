@@ -0,0 +1,37 @@
+#!/bin/bash
+# Times the compilation of generated scripts with many distinct literals, like
+# lookup tables. The time should grow linearly with the number of literals.
+# usage: ./compile-constants.sh [interpreter] [counts...]
+
+interpreter=$(realpath "${1:-../run}")
+shift
+counts=${@:-10000 20000 40000 80000}
+
+script=$(mktemp --suffix=.element)
+trap 'rm -f "$script"' EXIT
+
+TIMEFORMAT=%R
+
+for count in $counts
+do
+	# a third each of ints, floats and strings, then a repeat of all of them
+	awk -v count="$count" 'BEGIN {
+		print "t = []"
+		for(i = 0; i < count; ++i)
+		{
+			if(i % 3 == 0)
+				printf "t << %d\n", i
+			else if(i % 3 == 1)
+				printf "t << %d.5\n", i
+			else
+				printf "t << \"key%d\"\n", i
+		}
+		print "t << 0"
+		print "t << 1.5"
+		print "t << \"key2\""
+		print "print(#t, \"\\n\")"
+	}' > "$script"
+
+	seconds=$( { time (cd "$(dirname "$script")" && "$interpreter" "$(basename "$script")" > /dev/null 2>&1) ; } 2>&1 )
+	printf "%-8s literals %s s\n" "$count" "$seconds"
+done
@@ -0,0 +1,29 @@
+#!/bin/bash
+# Times the benchmark scripts, the examples and the mandelbrot generator.
+# usage: ./run-benchmarks.sh [interpreter] [runs] [options]
+# Reports the best wall clock time out of 'runs' for every script, the options
+# go to the interpreter, like -r to run on the register instructions.
+
+interpreter=$(realpath "${1:-../run}")
+runs=${2:-5}
+options=${3:-}
+
+cd "$(dirname "$0")"
+
+scripts="$(ls *.element) ../mandel2.msl $(ls ../examples/*.element)"
+
+TIMEFORMAT=%R
+
+for script in $scripts
+do
+	best=""
+	for ((i = 0; i < runs; i++))
+	do
+		seconds=$( { time (cd "$(dirname "$script")" && "$interpreter" $options "$(basename "$script")" > /dev/null 2>&1) ; } 2>&1 )
+		if [ -z "$best" ] || awk "BEGIN { exit !($seconds < $best) }"
+		then
+			best=$seconds
+		fi
+	done
+	printf "%-32s %s s\n" "$(basename "$script")" "$best"
+done
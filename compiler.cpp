@@ -10,7 +10,7 @@ using namespace std::string_literals;
 namespace element
 {
     Compiler::Compiler(Logger& logger)
-    : m_logger(logger), m_currfunction(nullptr), m_constoffset(0), m_symsoffset(0)
+    : m_logger(logger), m_currfunction(nullptr), m_constoffset(0), m_symsoffset(0), m_optlevel(1), m_backend(CB_Stack)
     {
         resetState();
     }
@@ -22,6 +22,16 @@ namespace element
         return buildBinaryData();
     }
 
+    void Compiler::setOptimizationLevel(int level)
+    {
+        m_optlevel = level;
+    }
+
+    void Compiler::setBackend(Backend backend)
+    {
+        m_backend = backend;
+    }
+
     void Compiler::resetState()
     {
         m_loopcontexts.clear();
@@ -36,6 +46,10 @@ namespace element
 
         m_constoffset = 0;
 
+        m_intindices.clear();
+        m_floatindices.clear();
+        m_strindices.clear();
+
         m_symindices.clear();
         m_symindices[Symbol::ProtoHash] = 0;
 
@@ -154,57 +168,30 @@ namespace element
             case ast::Node::N_Integer:
             {
                 int n = std::dynamic_pointer_cast<ast::IntegerNode>(node)->value;
-                for(unsigned i = 3; i < m_constants.size(); ++i)
-                {
-                    if(m_constants[i].equals(n))
-                    {
-                        index = i;
-                        break;
-                    }
-                }
-                if(index == 0)
-                {
-                    index = m_constants.size();
+                auto found = m_intindices.try_emplace(n, unsigned(m_constants.size()));
+                if(found.second)// not there yet
                     m_constants.emplace_back(n);
-                }
+                index = found.first->second;
                 break;
             }
 
             case ast::Node::N_Float:
             {
-                float f = std::dynamic_pointer_cast<ast::FloatNode>(node)->value;
-                for(unsigned i = 3; i < m_constants.size(); ++i)
-                {
-                    if(m_constants[i].equals(f))
-                    {
-                        index = i;
-                        break;
-                    }
-                }
-                if(index == 0)
-                {
-                    index = m_constants.size();
+                double f = std::dynamic_pointer_cast<ast::FloatNode>(node)->value;
+                auto found = m_floatindices.try_emplace(f, unsigned(m_constants.size()));
+                if(found.second)// not there yet
                     m_constants.emplace_back(f);
-                }
+                index = found.first->second;
                 break;
             }
 
             case ast::Node::N_String:
             {
                 const std::string& s = std::dynamic_pointer_cast<ast::StringNode>(node)->value;
-                for(unsigned i = 3; i < m_constants.size(); ++i)
-                {
-                    if(m_constants[i].equals(s))
-                    {
-                        index = i;
-                        break;
-                    }
-                }
-                if(index == 0)
-                {
-                    index = m_constants.size();
+                auto found = m_strindices.try_emplace(s, unsigned(m_constants.size()));
+                if(found.second)// not there yet
                     m_constants.emplace_back(s);
-                }
+                index = found.first->second;
                 break;
             }
 
@@ -737,7 +724,7 @@ namespace element
 
         m_loopcontexts.emplace_back();
         m_loopcontexts.back().keepValue = keepValue;
-        m_loopcontexts.back().forLoop = false;
+        m_loopcontexts.back().iterationValues = 0;
 
         if(keepValue)// if the loop doesn't run not even once, we still expect a value
             m_currfunction->instructions.emplace_back(OpCode::OC_LoadConstant, 0);
@@ -779,40 +766,104 @@ namespace element
         m_loopcontexts.pop_back();
     }
 
+    // A direct call to the 'range' native in a 'for' loop does not need the iterator
+    // object, the loop can count by itself. Returns the arguments of the call if so.
+    static std::shared_ptr<ast::ArgumentsNode> rangeArguments(const std::shared_ptr<ast::Node>& node)
+    {
+        if(node->type != ast::Node::N_FunctionCall)
+            return nullptr;
+
+        auto n = std::dynamic_pointer_cast<ast::FunctionCallNode>(node);
+
+        if(n->function->type != ast::Node::N_Variable)
+            return nullptr;
+
+        auto function = std::dynamic_pointer_cast<ast::VariableNode>(n->function);
+
+        if(function->variableType != ast::VariableNode::V_Named ||
+           function->semanticType != ast::VariableNode::SMT_Native ||
+           function->name != "range")
+            return nullptr;
+
+        auto argsNode = std::dynamic_pointer_cast<ast::ArgumentsNode>(n->arguments);
+
+        if(argsNode->arguments.empty() || argsNode->arguments.size() > 3)
+            return nullptr;// let 'range' report the error
+
+        return argsNode;
+    }
+
     void Compiler::buildForStmt(const std::shared_ptr<ast::Node>& node, bool keepValue)
     {
         auto n = std::dynamic_pointer_cast<ast::ForNode>(node);
 
-        // emit the value we will be iterating over
-        emitInstructions(n->iteratedExpression, true);
+        auto rangeArgs = rangeArguments(n->iteratedExpression);
+
+        // the default result is nil, it will be kept beneath the iteration state
+        if(keepValue)
+            m_currfunction->instructions.emplace_back(OpCode::OC_LoadConstant, 0);
 
         m_loopcontexts.emplace_back();
         m_loopcontexts.back().keepValue = keepValue;
-        m_loopcontexts.back().forLoop = true;
+        m_loopcontexts.back().iterationValues = rangeArgs ? 3 : 2;
+
+        int iterationValues = m_loopcontexts.back().iterationValues;
 
         // should we need to call 'return' from inside the loop, we will need to clean up
-        m_funcontexts.back().forLoopsGarbage += keepValue ? 2 : 1;
+        m_funcontexts.back().forLoopsGarbage += keepValue ? iterationValues + 1 : iterationValues;
 
-        // confirm we have an iterator object or make a default one for arrays and strings
-        m_currfunction->instructions.emplace_back(OpCode::OC_MakeIterator);
+        unsigned conditionLocation;
 
-        if(keepValue)// the default result is nil, it will be kept beneath the iterator
+        if(rangeArgs)
         {
-            m_currfunction->instructions.emplace_back(OpCode::OC_LoadConstant, 0);
-            m_currfunction->instructions.emplace_back(OpCode::OC_Rotate2);
+            const auto& arguments = rangeArgs->arguments;
+            const Location& coords = n->iteratedExpression->coords;
+
+            // emit 'from', 'to' and 'step' with the defaults of 'range'
+            if(arguments.size() == 1)
+                buildConstLoad(std::make_shared<ast::IntegerNode>(0, coords), true);
+
+            for(auto argument : arguments)
+                emitInstructions(argument, true);
+
+            if(arguments.size() < 3)
+                buildConstLoad(std::make_shared<ast::IntegerNode>(1, coords), true);
+
+            // check them like 'range' does and keep the counter above the limit and the step
+            m_currfunction->instructions.emplace_back(OpCode::OC_MakeRange, int(arguments.size()));
+
+            conditionLocation = m_currfunction->instructions.size();
+
+            // push the counter and advance it, or jump to 'end' once it reaches the limit
+            m_loopcontexts.back().jumpToEndIndices.push_back(m_currfunction->instructions.size());
+            m_currfunction->instructions.emplace_back(OpCode::OC_ForRange);
         }
+        else
+        {
+            // emit the value we will be iterating over
+            emitInstructions(n->iteratedExpression, true);
 
-        unsigned conditionLocation = m_currfunction->instructions.size();
+            // arrays and strings are iterated as they are, other values are made into an
+            // iterator object, the loop cursor is kept above them
+            m_currfunction->instructions.emplace_back(OpCode::OC_MakeIterator);
 
-        // 'has_next' will provide the condition
-        m_currfunction->instructions.emplace_back(OpCode::OC_IteratorHasNext);
+            conditionLocation = m_currfunction->instructions.size();
 
-        // if the condition fails jump to 'end'
-        m_loopcontexts.back().jumpToEndIndices.push_back(m_currfunction->instructions.size());
-        m_currfunction->instructions.emplace_back(OpCode::OC_PopJumpIfFalse);
+            // the built-in iterators are advanced by 'ForIter' itself, which jumps to 'end'
+            // when they are done and skips the 'has_next' and 'get_next' calls below
+            m_loopcontexts.back().jumpToEndIndices.push_back(m_currfunction->instructions.size());
+            m_currfunction->instructions.emplace_back(OpCode::OC_ForIter);
 
-        // 'get_next' will provide the new iterating variable
-        m_currfunction->instructions.emplace_back(OpCode::OC_IteratorGetNext);
+            // 'has_next' will provide the condition
+            m_currfunction->instructions.emplace_back(OpCode::OC_IteratorHasNext);
+
+            // if the condition fails jump to 'end'
+            m_loopcontexts.back().jumpToEndIndices.push_back(m_currfunction->instructions.size());
+            m_currfunction->instructions.emplace_back(OpCode::OC_PopJumpIfFalse);
+
+            // 'get_next' will provide the new iterating variable
+            m_currfunction->instructions.emplace_back(OpCode::OC_IteratorGetNext);
+        }
 
         // assign it to the iterating variable
         buildVarStore(n->iteratingVariable, false);
@@ -820,8 +871,8 @@ namespace element
         // emit the body
         emitInstructions(n->body, keepValue);
 
-        if(keepValue)// save the result value beneath the iterator object which will be at TOS1
-            m_currfunction->instructions.emplace_back(OpCode::OC_MoveToTOS2);
+        if(keepValue)// save the result value beneath the iteration state
+            m_currfunction->instructions.emplace_back(OpCode::OC_MoveToTOSN, iterationValues + 1);
 
         // jump back to the condition to try it again
         m_loopcontexts.back().jumpToConditionIndices.push_back(m_currfunction->instructions.size());
@@ -829,8 +880,8 @@ namespace element
 
         unsigned endLocation = m_currfunction->instructions.size();
 
-        // pop the iterator object
-        m_currfunction->instructions.emplace_back(OpCode::OC_Pop);
+        // pop the iteration state
+        m_currfunction->instructions.emplace_back(OpCode::OC_PopN, iterationValues);
 
         // fill placeholder jumps with proper locations
         LoopContext& context = m_loopcontexts.back();
@@ -847,7 +898,7 @@ namespace element
 
         m_loopcontexts.pop_back();
 
-        m_funcontexts.back().forLoopsGarbage -= keepValue ? 2 : 1;
+        m_funcontexts.back().forLoopsGarbage -= keepValue ? iterationValues + 1 : iterationValues;
     }
 
     void Compiler::buildBlockStmt(const std::shared_ptr<ast::Node>& node, bool keepValue)
@@ -908,6 +959,21 @@ namespace element
             jumpToEndInstruction.A = endLocation;
         }
 
+        if(m_optlevel > 0)
+            optimizeInstructions();
+
+        if(m_backend == CB_Registers)
+        {
+            RegisterCompiler registerCompiler;
+            registerCompiler.compile(m_currfunction);
+        }
+
+        // the VM reserves this much room for the operands when it calls the function
+        computeMaxStackDepth();
+
+        if(m_optlevel > 0)
+            fuseInstructions();
+
         m_funcontexts.pop_back();
 
         // back to old constant
@@ -1056,8 +1122,8 @@ namespace element
                     else
                         m_currfunction->instructions.emplace_back(OpCode::OC_LoadConstant, 0);
 
-                    if(context.forLoop)
-                        m_currfunction->instructions.emplace_back(OpCode::OC_MoveToTOS2);
+                    if(context.iterationValues > 0)
+                        m_currfunction->instructions.emplace_back(OpCode::OC_MoveToTOSN, context.iterationValues + 1);
                 }
 
                 context.jumpToEndIndices.push_back(m_currfunction->instructions.size());
@@ -1077,8 +1143,8 @@ namespace element
                     else
                         m_currfunction->instructions.emplace_back(OpCode::OC_LoadConstant, 0);
 
-                    if(context.forLoop)
-                        m_currfunction->instructions.emplace_back(OpCode::OC_MoveToTOS2);
+                    if(context.iterationValues > 0)
+                        m_currfunction->instructions.emplace_back(OpCode::OC_MoveToTOSN, context.iterationValues + 1);
                 }
 
                 context.jumpToConditionIndices.push_back(m_currfunction->instructions.size());
@@ -1109,6 +1175,427 @@ namespace element
         }
     }
 
+    // How many values an instruction leaves on the stack compared to before it,
+    // when the execution continues with the next instruction
+    static int stackEffect(const Instruction& instruction)
+    {
+        switch(instruction.opCode)
+        {
+            case OpCode::OC_Duplicate:
+            case OpCode::OC_LoadConstant:
+            case OpCode::OC_LoadLocal:
+            case OpCode::OC_LoadGlobal:
+            case OpCode::OC_LoadNative:
+            case OpCode::OC_LoadArgument:
+            case OpCode::OC_LoadArgsArray:
+            case OpCode::OC_LoadThis:
+            case OpCode::OC_MakeEmptyObject:
+            case OpCode::OC_LoadHash:
+            case OpCode::OC_MakeIterator:
+            case OpCode::OC_IteratorHasNext:
+            case OpCode::OC_IteratorGetNext:
+            case OpCode::OC_LoadFromBox:
+            case OpCode::OC_LoadFromClosure:
+                return 1;
+
+            case OpCode::OC_Pop:
+            case OpCode::OC_MoveToTOSN:
+            case OpCode::OC_PopStoreLocal:
+            case OpCode::OC_PopStoreGlobal:
+            case OpCode::OC_LoadElement:
+            case OpCode::OC_ArrayPushBack:
+            case OpCode::OC_LoadMember:
+            case OpCode::OC_PopStoreToBox:
+            case OpCode::OC_PopStoreToClosure:
+            case OpCode::OC_PopJumpIfFalse:
+            case OpCode::OC_JumpIfFalseOrPop:
+            case OpCode::OC_JumpIfTrueOrPop:
+                return -1;
+
+            case OpCode::OC_StoreElement:
+            case OpCode::OC_StoreMember:
+                return -2;
+
+            case OpCode::OC_PopStoreElement:
+            case OpCode::OC_PopStoreMember:
+                return -3;
+
+            case OpCode::OC_PopN:
+                return -instruction.A;
+
+            case OpCode::OC_Unpack:
+                return instruction.A - 1;
+
+            case OpCode::OC_MakeArray:
+                return 1 - instruction.A;
+
+            case OpCode::OC_MakeObject:
+                return 1 - 2 * instruction.A;
+
+            case OpCode::OC_FunctionCall:// the function and the arguments become the result
+                return -instruction.A;
+
+            default:
+                break;
+        }
+
+        if(instruction.opCode >= OpCode::OC_Add && instruction.opCode <= OpCode::OC_GreaterEqual)
+            return -1;
+
+        if(instruction.opCode >= OpCode::OC_AddIntInt && instruction.opCode <= OpCode::OC_GreaterEqualFloatFloat)
+            return -1;
+
+        return 0;
+    }
+
+    void Compiler::computeMaxStackDepth()
+    {
+        const std::vector<Instruction>& instructions = m_currfunction->instructions;
+        int instructionsCount = int(instructions.size());
+
+        // the stack depth before each instruction, -1 until a path reaches it
+        std::vector<int> depths(instructionsCount, -1);
+        std::vector<int> pending;
+
+        auto reach = [&](int index, int depth)
+        {
+            if(index >= 0 && index < instructionsCount && depths[index] < 0)
+            {
+                depths[index] = depth;
+                pending.push_back(index);
+            }
+        };
+
+        int maxDepth = 0;
+
+        reach(0, 0);
+
+        while(!pending.empty())
+        {
+            int index = pending.back();
+            pending.pop_back();
+
+            const Instruction& instruction = instructions[index];
+            int depth = depths[index];
+            int nextDepth = depth + stackEffect(instruction);
+
+            maxDepth = std::max(maxDepth, nextDepth);
+
+            // the register instructions push their operands for the operators they fall back to
+            if(instruction.opCode >= OpCode::OC_AddRegisters)
+            {
+                maxDepth = std::max(maxDepth, depth + 2);
+
+                if(isJump(instruction.opCode))
+                    reach(instruction.A, depth);
+            }
+
+            switch(instruction.opCode)
+            {
+                case OpCode::OC_Jump:
+                    reach(instruction.A, depth);
+                    break;
+
+                case OpCode::OC_JumpIfFalse:
+                case OpCode::OC_JumpIfFalseOrPop:
+                case OpCode::OC_JumpIfTrueOrPop:// TOS stays when jumping
+                    reach(instruction.A, depth);
+                    reach(index + 1, nextDepth);
+                    break;
+
+                case OpCode::OC_PopJumpIfFalse:
+                    reach(instruction.A, nextDepth);
+                    reach(index + 1, nextDepth);
+                    break;
+
+                case OpCode::OC_ForRange:// the counter is pushed unless the loop is done
+                    maxDepth = std::max(maxDepth, depth + 1);
+                    reach(instruction.A, depth);
+                    reach(index + 1, depth + 1);
+                    break;
+
+                case OpCode::OC_ForIter:// the built-in iterators push the next value past the generic protocol
+                    maxDepth = std::max(maxDepth, depth + 1);
+                    reach(instruction.A, depth);
+                    reach(index + 1, depth);
+                    reach(index + 4, depth + 1);
+                    break;
+
+                case OpCode::OC_EndFunction:
+                    break;
+
+                default:
+                    reach(index + 1, nextDepth);
+                    break;
+            }
+        }
+
+        m_currfunction->maxStackDepth = maxDepth;
+    }
+
+    // the store that also pops TOS, or the same opcode if there is none
+    static OpCode popStoreOf(OpCode opCode)
+    {
+        switch(opCode)
+        {
+            case OpCode::OC_StoreLocal:
+                return OpCode::OC_PopStoreLocal;
+            case OpCode::OC_StoreGlobal:
+                return OpCode::OC_PopStoreGlobal;
+            case OpCode::OC_StoreToBox:
+                return OpCode::OC_PopStoreToBox;
+            case OpCode::OC_StoreToClosure:
+                return OpCode::OC_PopStoreToClosure;
+            case OpCode::OC_StoreElement:
+                return OpCode::OC_PopStoreElement;
+            case OpCode::OC_StoreMember:
+                return OpCode::OC_PopStoreMember;
+            default:
+                return opCode;
+        }
+    }
+
+    // the store that keeps TOS, or the same opcode if there is none
+    static OpCode storeOf(OpCode opCode)
+    {
+        switch(opCode)
+        {
+            case OpCode::OC_PopStoreLocal:
+                return OpCode::OC_StoreLocal;
+            case OpCode::OC_PopStoreGlobal:
+                return OpCode::OC_StoreGlobal;
+            case OpCode::OC_PopStoreToBox:
+                return OpCode::OC_StoreToBox;
+            case OpCode::OC_PopStoreToClosure:
+                return OpCode::OC_StoreToClosure;
+            default:
+                return opCode;
+        }
+    }
+
+    // the load of the variable a 'PopStore' writes to
+    static bool loadsStored(OpCode load, OpCode popStore)
+    {
+        return (load == OpCode::OC_LoadLocal && popStore == OpCode::OC_PopStoreLocal)
+               || (load == OpCode::OC_LoadGlobal && popStore == OpCode::OC_PopStoreGlobal)
+               || (load == OpCode::OC_LoadFromBox && popStore == OpCode::OC_PopStoreToBox)
+               || (load == OpCode::OC_LoadFromClosure && popStore == OpCode::OC_PopStoreToClosure);
+    }
+
+    // the pushes that have no other effect, a 'Pop' right after them undoes them
+    static bool isPlainPush(OpCode opCode)
+    {
+        return opCode == OpCode::OC_Duplicate || opCode == OpCode::OC_LoadConstant || opCode == OpCode::OC_LoadLocal
+               || opCode == OpCode::OC_LoadGlobal || opCode == OpCode::OC_LoadNative || opCode == OpCode::OC_LoadArgument
+               || opCode == OpCode::OC_LoadThis || opCode == OpCode::OC_LoadFromBox || opCode == OpCode::OC_LoadFromClosure;
+    }
+
+    // Rewrites 'previous' followed by 'next' in place. Returns 0 when it can't, 1 when
+    // 'previous' now does what both did and 2 when neither has to run.
+    static int mergeInstructions(Instruction& previous, const Instruction& next)
+    {
+        if(next.opCode == OpCode::OC_Pop)
+        {
+            if(isPlainPush(previous.opCode))
+                return 2;
+
+            if(popStoreOf(previous.opCode) != previous.opCode)
+            {
+                previous.opCode = popStoreOf(previous.opCode);
+                return 1;
+            }
+
+            if(previous.opCode == OpCode::OC_Pop || previous.opCode == OpCode::OC_PopN)
+            {
+                previous.A = previous.opCode == OpCode::OC_Pop ? 2 : previous.A + 1;
+                previous.opCode = OpCode::OC_PopN;
+                return 1;
+            }
+        }
+
+        // storing and loading back the same variable keeps it on the stack instead
+        if(loadsStored(next.opCode, previous.opCode) && next.A == previous.A)
+        {
+            previous.opCode = storeOf(previous.opCode);
+            return 1;
+        }
+
+        if(previous.opCode == OpCode::OC_Duplicate && storeOf(next.opCode) != next.opCode)
+        {
+            previous = Instruction(storeOf(next.opCode), next.A);
+            return 1;
+        }
+
+        // a condition known while compiling, nil, true and false are the first constants
+        if(next.opCode == OpCode::OC_PopJumpIfFalse && previous.opCode == OpCode::OC_LoadConstant && previous.A <= 2)
+        {
+            if(previous.A == 1)// true, never jumps
+                return 2;
+
+            previous = Instruction(OpCode::OC_Jump, next.A);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    // Jump threading and the merging of neighbouring instructions, on the current
+    // function once all its jumps are known. An instruction that is jumped to is never
+    // merged into the one before it, the jumps and the lines are moved to the new indices.
+    void Compiler::optimizeInstructions()
+    {
+        std::vector<Instruction>& instructions = m_currfunction->instructions;
+        int instructionsCount = int(instructions.size());
+
+        // a jump to a jump goes straight to where the second one goes, the conditional
+        // jumps that keep TOS jump again when they land on the same test of it
+        for(Instruction& instruction : instructions)
+        {
+            if(!isJump(instruction.opCode))
+                continue;
+
+            for(int hops = 0; hops < instructionsCount; ++hops)
+            {
+                const Instruction& target = instructions[instruction.A];
+
+                bool sameTest = target.opCode == instruction.opCode && (target.opCode == OpCode::OC_JumpIfFalse
+                                || target.opCode == OpCode::OC_JumpIfFalseOrPop || target.opCode == OpCode::OC_JumpIfTrueOrPop);
+
+                if((target.opCode != OpCode::OC_Jump && !sameTest) || target.A == instruction.A)
+                    break;
+
+                instruction.A = target.A;
+            }
+
+            // a 'return' ends the function where it is
+            if(instruction.opCode == OpCode::OC_Jump && instructions[instruction.A].opCode == OpCode::OC_EndFunction)
+                instruction = instructions[instruction.A];
+        }
+
+        std::vector<bool> jumpedTo(instructionsCount + 1, false);
+
+        for(int i = 0; i < instructionsCount; ++i)
+        {
+            if(isJump(instructions[i].opCode))
+                jumpedTo[instructions[i].A] = true;
+
+            // 'ForIter' skips the next 3 instructions, they have to stay where they are
+            if(instructions[i].opCode == OpCode::OC_ForIter)
+                for(int skipped = 1; skipped <= 4 && i + skipped <= instructionsCount; ++skipped)
+                    jumpedTo[i + skipped] = true;
+        }
+
+        std::vector<Instruction> optimized;
+        std::vector<bool> optimizedJumpedTo;
+        std::vector<int> newIndices(instructionsCount + 1);
+        bool landing = false;// the jumps to a dropped instruction land on the next one
+
+        for(int i = 0; i < instructionsCount; ++i)
+        {
+            const Instruction& instruction = instructions[i];
+            bool isJumpedTo = jumpedTo[i] || landing;
+
+            newIndices[i] = int(optimized.size());
+            landing = false;
+
+            if(instruction.opCode == OpCode::OC_Jump && instruction.A == i + 1)// jumps to the next instruction
+            {
+                landing = isJumpedTo;
+                continue;
+            }
+
+            int merged = !optimized.empty() && !isJumpedTo ? mergeInstructions(optimized.back(), instruction) : 0;
+
+            if(merged == 1)
+                continue;
+
+            if(merged == 2)
+            {
+                landing = optimizedJumpedTo.back();
+                optimized.pop_back();
+                optimizedJumpedTo.pop_back();
+                newIndices[i] = int(optimized.size());
+                continue;
+            }
+
+            optimized.push_back(instruction);
+            optimizedJumpedTo.push_back(isJumpedTo);
+        }
+
+        newIndices[instructionsCount] = int(optimized.size());
+
+        for(Instruction& instruction : optimized)
+            if(isJump(instruction.opCode))
+                instruction.A = newIndices[instruction.A];
+
+        // the first instruction of a line may be gone, the line starts at the next one then
+        std::vector<SourceCodeLine> lines;
+
+        for(SourceCodeLine line : m_currfunction->instructionLines)
+        {
+            line.instructionIndex = newIndices[line.instructionIndex];
+
+            if(!lines.empty() && lines.back().instructionIndex == line.instructionIndex)
+                lines.pop_back();
+
+            if(lines.empty() || lines.back().line != line.line)
+                lines.push_back(line);
+        }
+
+        instructions = std::move(optimized);
+        m_currfunction->instructionLines = std::move(lines);
+    }
+
+    // The most frequent sequences of instructions in the benchmarks, the longer first.
+    // Their first instruction takes the opcode of the superinstruction.
+    static const struct
+    {
+        OpCode fused;
+        std::vector<OpCode> sequence;
+    }
+    superinstructions[] =
+    {
+        { OpCode::OC_AddLocalConstantStore, { OpCode::OC_LoadLocal, OpCode::OC_LoadConstant, OpCode::OC_Add, OpCode::OC_PopStoreLocal } },
+        { OpCode::OC_LessLocalConstantJump, { OpCode::OC_LoadLocal, OpCode::OC_LoadConstant, OpCode::OC_Less, OpCode::OC_PopJumpIfFalse } },
+        { OpCode::OC_AddLocalLocal, { OpCode::OC_LoadLocal, OpCode::OC_LoadLocal, OpCode::OC_Add } },
+        { OpCode::OC_LoadLocalLocal, { OpCode::OC_LoadLocal, OpCode::OC_LoadLocal } },
+        { OpCode::OC_LoadGlobalGlobal, { OpCode::OC_LoadGlobal, OpCode::OC_LoadGlobal } },
+        { OpCode::OC_LoadLocalConstant, { OpCode::OC_LoadLocal, OpCode::OC_LoadConstant } },
+        { OpCode::OC_LoadHashMember, { OpCode::OC_LoadHash, OpCode::OC_LoadMember } },
+    };
+
+    // Marks the start of the sequences that the VM runs as superinstructions. Only
+    // the opcode of the first instruction changes, so the jumps into the middle of a
+    // sequence, the lines and the stack depth stay as they are.
+    void Compiler::fuseInstructions()
+    {
+        std::vector<Instruction>& instructions = m_currfunction->instructions;
+        size_t instructionsCount = instructions.size();
+
+        for(size_t i = 0; i < instructionsCount; ++i)
+        {
+            for(const auto& superinstruction : superinstructions)
+            {
+                const std::vector<OpCode>& sequence = superinstruction.sequence;
+
+                if(i + sequence.size() > instructionsCount)
+                    continue;
+
+                bool matches = true;
+
+                for(size_t k = 0; k < sequence.size() && matches; ++k)
+                    matches = instructions[i + k].opCode == sequence[k];
+
+                if(!matches)
+                    continue;
+
+                instructions[i].opCode = superinstruction.fused;
+                i += sequence.size() - 1;
+                break;
+            }
+        }
+    }
+
     unsigned Compiler::updateSymbol(const std::string& name)
     {
         unsigned hash = Symbol::Hash(name);
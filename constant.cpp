@@ -19,7 +19,7 @@ namespace element
     {
     }
 
-    Constant::Constant(float floatingPoint) : type(CT_Float), floatingPoint(floatingPoint)
+    Constant::Constant(double floatingPoint) : type(CT_Float), floatingPoint(floatingPoint)
     {
     }
 
@@ -36,30 +36,6 @@ namespace element
         clear();
     }
 
-    bool Constant::equals(int i) const
-    {
-        if(type != CT_Integer)
-            return false;
-
-        return integer == i;
-    }
-
-    bool Constant::equals(float f) const
-    {
-        if(type != CT_Float)
-            return false;
-
-        return floatingPoint == f;
-    }
-
-    bool Constant::equals(const std::string& str) const
-    {
-        if(type != CT_String || !string)
-            return false;
-
-        return *string == str;
-    }
-
     void Constant::clear()
     {
         if(type == CT_String && string)
@@ -90,7 +66,7 @@ namespace element
                 unsigned instructionsCount = codeObject ? codeObject->instructions.size() : 0;
                 unsigned linesCount = codeObject ? codeObject->instructionLines.size() : 0;
 
-                return sizeof(Constant::Type) + 3 * sizeof(unsigned) + 2 * sizeof(int) + closureSize * sizeof(int)
+                return sizeof(Constant::Type) + 3 * sizeof(unsigned) + 3 * sizeof(int) + closureSize * sizeof(int)
                        + instructionsCount * sizeof(Instruction) + linesCount * sizeof(SourceCodeLine);
             }
         }
@@ -163,6 +139,11 @@ namespace element
                 memcpy(memoryDestination, &paramsCount, sizeof(int));
                 memoryDestination += sizeof(int);
 
+                int stackDepth = codeObject ? codeObject->maxStackDepth : 0;
+
+                memcpy(memoryDestination, &stackDepth, sizeof(int));
+                memoryDestination += sizeof(int);
+
                 if(codeObject && closureSize > 0)
                 {
                     unsigned size = closureSize * sizeof(int);
@@ -251,6 +232,11 @@ namespace element
                 memcpy(&paramsCount, memorySource, sizeof(int));
                 memorySource += sizeof(int);
 
+                int stackDepth = 0;
+
+                memcpy(&stackDepth, memorySource, sizeof(int));
+                memorySource += sizeof(int);
+
                 codeObject = new CodeObject();
 
                 if(closureSize > 0)
@@ -273,6 +259,7 @@ namespace element
 
                 codeObject->localVariablesCount = localsCount;
                 codeObject->namedParametersCount = paramsCount;
+                codeObject->maxStackDepth = stackDepth;
 
                 return memorySource;
             }
@@ -306,7 +293,8 @@ namespace element
             {
                 std::stringstream result;
                 result << "function - " << codeObject->localVariablesCount << " locals ("
-                       << codeObject->namedParametersCount << " parameters)\n";
+                       << codeObject->namedParametersCount << " parameters), stack depth "
+                       << codeObject->maxStackDepth << "\n";
 
                 unsigned linesIndex = 0;
                 unsigned closureSize = codeObject->closureMapping.size();
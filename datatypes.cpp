@@ -7,16 +7,66 @@
 
 namespace element
 {
-    CodeObject::CodeObject() : module(nullptr), localVariablesCount(0), namedParametersCount(0)
+    CodeObject::CodeObject() : module(nullptr), localVariablesCount(0), namedParametersCount(0), maxStackDepth(0)
     {
     }
 
-    CodeObject::CodeObject(Instruction* instructions, unsigned instructionsSize, SourceCodeLine* lines, unsigned linesSize, int localVariablesCount, int namedParametersCount)
+    CodeObject::CodeObject(Instruction* instructions, unsigned instructionsSize, SourceCodeLine* lines, unsigned linesSize, int localVariablesCount, int namedParametersCount, int maxStackDepth)
     : instructions(instructions, instructions + instructionsSize), module(nullptr), localVariablesCount(localVariablesCount),
-      namedParametersCount(namedParametersCount), instructionLines(lines, lines + linesSize)
+      namedParametersCount(namedParametersCount), maxStackDepth(maxStackDepth), instructionLines(lines, lines + linesSize)
     {
     }
 
+    Value Native::call(VirtualMachine& vm, const Value& thisObject, Arguments args) const
+    {
+        if(function)
+            return function(vm, thisObject, args);
+
+        return vectorFunction(vm, thisObject, std::vector<Value>(args.begin(), args.end()));
+    }
+
+    void ValueStack::resize(unsigned newSize)
+    {
+        Value* newTop = values.data() + newSize;
+
+        if(newTop > top)
+            std::fill(top, newTop, Value());
+
+        top = newTop;
+    }
+
+    void ValueStack::reserve(unsigned count)
+    {
+        unsigned used = size();
+
+        if(used + count > values.size())
+        {
+            values.resize(std::max<size_t>(used + count, 2 * values.size()));
+            top = values.data() + used;
+        }
+    }
+
+    InlineCache::InlineCache(Kind kind, unsigned instructionIndex)
+    : entries(), hash(0), instructionIndex(instructionIndex), hits(0), misses(0), entriesCount(0), kind(kind), megamorphic(false)
+    {
+    }
+
+    const char* InlineCache::stateName() const
+    {
+        if(megamorphic)
+            return "megamorphic";
+
+        switch(entriesCount)
+        {
+            case 0:
+                return "uninitialized";
+            case 1:
+                return "monomorphic";
+            default:
+                return "polymorphic";
+        }
+    }
+
     std::string bytecodeSymbolsToString(const char* bytecode)
     {
         unsigned* p = (unsigned*)bytecode;
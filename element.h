@@ -5,6 +5,8 @@
 #include <istream>
 #include <sstream>
 #include <memory>
+#include <atomic>
+#include <thread>
 #include <deque>
 #include <unordered_map>
 #include <string>
@@ -15,6 +17,9 @@
 #include <limits>
 #include <cmath>
 #include <cstring>
+#include <cstdint>
+#include <bit>
+#include <type_traits>
 #include <stdarg.h>
 #include <limits.h>
 #include <sys/types.h>
@@ -34,6 +39,9 @@ namespace element
     struct /**/Error;
     class /**/VirtualMachine;
     struct /**/ExecutionContext;
+    class /**/MemoryManager;
+    struct /**/Arguments;
+    struct /**/Native;
 
     namespace ast
     {
@@ -133,7 +141,7 @@ namespace element
         OC_Pop,// pop TOS
         OC_PopN,// pop A values from the stack
         OC_Rotate2,// swap TOS and TOS1
-        OC_MoveToTOS2,// copy TOS over TOS2 and pop TOS
+        OC_MoveToTOSN,// copy TOS over the value A places beneath it and pop TOS
         OC_Duplicate,// make a copy of TOS and push it to the stack
         OC_Unpack,// A is the number of values to be produced from the TOS value
 
@@ -171,9 +179,12 @@ namespace element
         OC_PopStoreMember,// TOS member hash, TOS1 object, TOS2 new value
 
         // iterators
-        OC_MakeIterator,// make an iterator object from TOS and replace it at TOS
-        OC_IteratorHasNext,// call 'has_next' from the TOS object
-        OC_IteratorGetNext,// call 'get_next' from the TOS object
+        OC_MakeIterator,// make the iterated value at TOS1 from TOS and push the loop cursor
+        OC_ForIter,// push the next value of TOS1 and skip the 3 generic instructions after it, jump to A when done
+        OC_MakeRange,// turn TOS2 from, TOS1 to, TOS step into TOS2 to, TOS1 step, TOS counter, A is the 'range' arguments count
+        OC_ForRange,// push the TOS counter and advance it by TOS1 while it is below TOS2, otherwise jump to A
+        OC_IteratorHasNext,// call 'has_next' from the TOS1 object
+        OC_IteratorGetNext,// call 'get_next' from the TOS1 object
 
         // closures
         OC_MakeBox,// A is the index of the box that needs to be created
@@ -220,6 +231,67 @@ namespace element
         OC_UnaryNot,
         OC_UnaryConcatenate,
         OC_UnarySizeOf,
+
+        // binary operations specialized for the operand types, the VM rewrites
+        // the generic ones to these while running and back if the types change
+        OC_AddIntInt,
+        OC_AddFloatFloat,
+        OC_SubtractIntInt,
+        OC_SubtractFloatFloat,
+        OC_MultiplyIntInt,
+        OC_MultiplyFloatFloat,
+        OC_DivideIntInt,
+        OC_DivideFloatFloat,
+        OC_ModuloIntInt,
+        OC_ConcatenateStrStr,
+        OC_EqualIntInt,
+        OC_NotEqualIntInt,
+        OC_LessIntInt,
+        OC_LessFloatFloat,
+        OC_GreaterIntInt,
+        OC_GreaterFloatFloat,
+        OC_LessEqualIntInt,
+        OC_LessEqualFloatFloat,
+        OC_GreaterEqualIntInt,
+        OC_GreaterEqualFloatFloat,
+
+        // superinstructions, the compiler gives their opcode to the first instruction of
+        // a common sequence and leaves the others in place, the VM runs the sequence in
+        // one go when the operand types allow it and otherwise just the first instruction
+        OC_LoadLocalLocal,// LoadLocal, LoadLocal
+        OC_LoadGlobalGlobal,// LoadGlobal, LoadGlobal
+        OC_LoadLocalConstant,// LoadLocal, LoadConstant
+        OC_AddLocalLocal,// LoadLocal, LoadLocal, Add
+        OC_AddLocalConstantStore,// LoadLocal, LoadConstant, Add, PopStoreLocal
+        OC_LessLocalConstantJump,// LoadLocal, LoadConstant, Less, PopJumpIfFalse
+        OC_LoadHashMember,// LoadHash, LoadMember
+
+        // three-address instructions of the register backend, A B C are indices of
+        // locals (registers), C is the index of a constant in the ...Constant ones
+        OC_MoveRegister,// A = C
+        OC_MoveConstant,// A = C
+        OC_AddRegisters,// A = B + C
+        OC_AddRegisterConstant,
+        OC_SubtractRegisters,// A = B - C
+        OC_SubtractRegisterConstant,
+        OC_MultiplyRegisters,// A = B * C
+        OC_MultiplyRegisterConstant,
+        OC_DivideRegisters,// A = B / C
+        OC_DivideRegisterConstant,
+        OC_EqualRegistersJump,// jump to A if B == C is false
+        OC_EqualRegisterConstantJump,
+        OC_NotEqualRegistersJump,// jump to A if B != C is false
+        OC_NotEqualRegisterConstantJump,
+        OC_LessRegistersJump,// jump to A if B < C is false
+        OC_LessRegisterConstantJump,
+        OC_GreaterRegistersJump,// jump to A if B > C is false
+        OC_GreaterRegisterConstantJump,
+        OC_LessEqualRegistersJump,// jump to A if B <= C is false
+        OC_LessEqualRegisterConstantJump,
+        OC_GreaterEqualRegistersJump,// jump to A if B >= C is false
+        OC_GreaterEqualRegisterConstantJump,
+
+        OC_OpCodesCount// not an opcode, the number of opcodes
     };
 
 
@@ -326,9 +398,9 @@ namespace element
 
         struct FloatNode : public Node
         {
-            float value;
+            double value;
 
-            FloatNode(float value, const Location& coords);
+            FloatNode(double value, const Location& coords);
         };
 
         struct BoolNode : public Node
@@ -525,7 +597,7 @@ namespace element
             {
                 bool boolean;
                 int integer;
-                float floatingPoint;
+                double floatingPoint;
                 std::string* string;
                 CodeObject* codeObject;
                 unsigned size;
@@ -535,15 +607,11 @@ namespace element
             Constant();
             Constant(bool boolean);
             Constant(int integer);
-            Constant(float floatingPoint);
+            Constant(double floatingPoint);
             Constant(const std::string& string);
             Constant(CodeObject* codeObject);
             ~Constant();
 
-            bool equals(int i) const;
-            bool equals(float f) const;
-            bool equals(const std::string& str) const;
-
             void clear();
 
             unsigned getSize() const;
@@ -580,6 +648,12 @@ namespace element
     class Compiler
     {
         public:
+            enum Backend : char
+            {
+                CB_Stack,// operands on the value stack
+                CB_Registers,// three-address instructions on the locals where they fit
+            };
+
             struct FunctionContext
             {
                 std::vector<unsigned> jumpToEndIndices;
@@ -593,7 +667,7 @@ namespace element
                 std::vector<unsigned> jumpToConditionIndices;
                 std::vector<unsigned> jumpToEndIndices;
                 bool keepValue;
-                bool forLoop;
+                int iterationValues;// kept by 'for' loops above their result
             };
 
        private:
@@ -607,15 +681,25 @@ namespace element
             std::deque<Constant> m_constants;
             unsigned m_constoffset;
 
+            // where each int, float and string constant is, to use it again
+            std::unordered_map<int, unsigned> m_intindices;
+            std::unordered_map<double, unsigned> m_floatindices;
+            std::unordered_map<std::string, unsigned> m_strindices;
+
             std::unordered_map<unsigned, unsigned> m_symindices;
             std::vector<Symbol> m_symbols;
             unsigned m_symsoffset;
 
+            int m_optlevel;// 0 leaves the instructions as they are emitted
+            Backend m_backend;
+
         public:
             Compiler(Logger& logger);
 
             auto compile(const std::shared_ptr<ast::FunctionNode>& node) -> std::unique_ptr<char[]>;
 
+            void setOptimizationLevel(int level);
+            void setBackend(Backend backend);
             void resetState();
 
         protected:
@@ -642,6 +726,10 @@ namespace element
             bool buildHashLoadOp(const std::shared_ptr<ast::Node>& node);
             void buildJumpStmt(const std::shared_ptr<ast::Node>& node);
 
+            void optimizeInstructions();
+            void computeMaxStackDepth();
+            void fuseInstructions();
+
             unsigned updateSymbol(const std::string& name);
 
             std::unique_ptr<char[]> buildBinaryData();
@@ -654,6 +742,8 @@ namespace element
     struct Instruction
     {
         OpCode opCode;
+        unsigned char B;// the operands of the register instructions, A is the result
+        unsigned short C;// or where they jump to
 
         union
         {
@@ -661,13 +751,50 @@ namespace element
             unsigned H;
         };
 
-        Instruction(OpCode opCode, int A = 0);
+        Instruction(OpCode opCode, int A = 0, int B = 0, int C = 0);
 
         std::string asString() const;
     };
 
+    // the instructions whose A is the index of another instruction
+    bool isJump(OpCode opCode);
+
+    // The register backend. It translates the stack instructions of a function to the
+    // three-address ones where the operands are locals or constants: the values that
+    // would be pushed are kept aside until an instruction takes them as operands, or
+    // are pushed before any other instruction. Intermediate results go to extra
+    // locals past the ones of the function.
+    class RegisterCompiler
+    {
+        private:
+            struct Operand
+            {
+                int index;// of the local or of the constant
+                bool constant;
+            };
+
+            std::vector<Operand> m_pending;// the values still to push, in stack order
+            std::vector<Instruction> m_translated;
+            int m_firsttemp;
+            int m_tempscount;
+
+        protected:
+            void pushPending();
+            bool pendingUses(int local) const;
+            int nextTemporary() const;
+
+        public:
+            RegisterCompiler();
+            void compile(CodeObject* function);
+    };
 
 
+
+    // A value is NaN-boxed into 64 bits. Floats are stored as plain doubles and
+    // every other type lives in the payload of a negative quiet NaN, with the type
+    // in bits 48 to 51. Float math that produces a NaN is canonicalized to a
+    // positive NaN so it never looks like a boxed value. Pointers must fit in the
+    // 48 bits of the payload, which holds for user space on x86-64 and AArch64.
     struct Value
     {
         enum Type : char
@@ -688,65 +815,113 @@ namespace element
             VT_Error = 12,
         };
 
-        Type type;
+        // natives get a view of their arguments right on the VM stack, the older
+        // vector form is still accepted and gets a copy of them
+        typedef Value (*NativeFunction)(VirtualMachine&, const Value&, Arguments);
+        typedef Value (*VectorNativeFunction)(VirtualMachine&, const Value&, const std::vector<Value>&);
 
-        typedef Value (*NativeFunction)(VirtualMachine&, const Value&, const std::vector<Value>&);
+        static constexpr uint64_t TagBase = 0xFFF1000000000000ull;// the tag of nil, the other types follow
+        static constexpr uint64_t PayloadMask = 0x0000FFFFFFFFFFFFull;
+        static constexpr uint64_t CanonicalNaN = 0x7FF8000000000000ull;
 
-        union
-        {
-            int integer;
-            float floatingPoint;
-            bool boolean;
-            unsigned hash;
-            String* string;
-            Array* array;
-            Object* object;
-            Function* function;
-            Box* box;
-            Iterator* iterator;
-            NativeFunction nativeFunction;
-            Error* error;
-
-            GarbageCollected* garbageCollected;
-        };
+        uint64_t bits;
 
-        Value();
-        Value(int integer);
-        Value(float floatingPoint);
-        Value(bool boolean);
-        Value(unsigned hash);
-        Value(String* string);
-        Value(Array* array);
-        Value(Object* object);
-        Value(Function* function);
-        Value(Box* box);
-        Value(Iterator* iterator);
-        Value(NativeFunction nativeFunction);
-        Value(Error* error);
-
-        Value(const Value& o);
+        static constexpr uint64_t tagOf(Type type)
+        {
+            return TagBase + (uint64_t(type) << 48);
+        }
+
+        Value() : bits(tagOf(VT_Nil)) {}
+        Value(int integer) : bits(tagOf(VT_Int) | uint32_t(integer)) {}
+        Value(double floatingPoint) : bits(floatingPoint == floatingPoint ? std::bit_cast<uint64_t>(floatingPoint) : CanonicalNaN) {}
+        Value(bool boolean) : bits(tagOf(VT_Bool) | uint64_t(boolean)) {}
+        Value(unsigned hash) : bits(tagOf(VT_Hash) | hash) {}
+        Value(String* string) : bits(boxPointer(VT_String, string)) {}
+        Value(Array* array) : bits(boxPointer(VT_Array, array)) {}
+        Value(Object* object) : bits(boxPointer(VT_Object, object)) {}
+        Value(Function* function) : bits(boxPointer(VT_Function, function)) {}
+        Value(Box* box) : bits(boxPointer(VT_Box, box)) {}
+        Value(Iterator* iterator) : bits(boxPointer(VT_Iterator, iterator)) {}
+        Value(const Native* native) : bits(boxPointer(VT_NativeFunction, native)) {}
+        Value(Error* error) : bits(boxPointer(VT_Error, error)) {}
+
+        Type type() const { return bits >= TagBase ? Type((bits - TagBase) >> 48) : VT_Float; }
+
+        int integer() const { return int(uint32_t(bits)); }
+        double floatingPoint() const { return std::bit_cast<double>(bits); }
+        bool boolean() const { return bits & 1; }
+        unsigned hash() const { return unsigned(bits); }
+        String* string() const { return (String*)(bits & PayloadMask); }
+        Array* array() const { return (Array*)(bits & PayloadMask); }
+        Object* object() const { return (Object*)(bits & PayloadMask); }
+        Function* function() const { return (Function*)(bits & PayloadMask); }
+        Box* box() const { return (Box*)(bits & PayloadMask); }
+        Iterator* iterator() const { return (Iterator*)(bits & PayloadMask); }
+        const Native* native() const { return (const Native*)(bits & PayloadMask); }
+        Error* error() const { return (Error*)(bits & PayloadMask); }
+        GarbageCollected* garbageCollected() const { return (GarbageCollected*)(bits & PayloadMask); }
 
         bool isManaged() const;
-        bool isNil() const;
+        void relocate(const GarbageCollected* gc) { bits = boxPointer(type(), gc); }// the same value, moved by the collector
+        bool isNil() const { return bits == tagOf(VT_Nil); }
         bool isFunction() const;
-        bool isArray() const;
-        bool isObject() const;
-        bool isString() const;
-        bool isBoolean() const;
-        bool isNumber() const;
-        bool isFloat() const;
-        bool isInt() const;
-        bool IsHash() const;
-        bool isBox() const;
-        bool isIterator() const;
-        bool isError() const;
-
-        int toInt() const;
-        float asFloat() const;
+        bool isArray() const { return (bits & ~PayloadMask) == tagOf(VT_Array); }
+        bool isObject() const { return (bits & ~PayloadMask) == tagOf(VT_Object); }
+        bool isString() const { return (bits & ~PayloadMask) == tagOf(VT_String); }
+        bool isBoolean() const { return (bits & ~PayloadMask) == tagOf(VT_Bool); }
+        bool isNumber() const { return isInt() || isFloat(); }
+        bool isFloat() const { return bits < TagBase; }
+        bool isInt() const { return (bits & ~PayloadMask) == tagOf(VT_Int); }
+        bool IsHash() const { return (bits & ~PayloadMask) == tagOf(VT_Hash); }
+        bool isBox() const { return (bits & ~PayloadMask) == tagOf(VT_Box); }
+        bool isIterator() const { return (bits & ~PayloadMask) == tagOf(VT_Iterator); }
+        bool isError() const { return (bits & ~PayloadMask) == tagOf(VT_Error); }
+
+        int toInt() const { return isInt() ? integer() : int(floatingPoint()); }
+        double asFloat() const { return isFloat() ? floatingPoint() : double(integer()); }
         bool asBool() const;
-        unsigned asHash() const;
+        unsigned asHash() const { return hash(); }
         std::string asString() const;
+
+        private:
+            static uint64_t boxPointer(Type type, const void* pointer)
+            {
+                return tagOf(type) | (uint64_t(uintptr_t(pointer)) & PayloadMask);
+            }
+    };
+
+    static_assert(sizeof(Value) == 8 && std::is_trivially_copyable<Value>::value,
+                  "Value must stay an 8 byte trivially copyable type");
+
+    // The arguments of a native function, a view on the values the VM passes to it
+    // which stays valid until the native returns
+    struct Arguments
+    {
+        const Value* values;
+        unsigned count;
+
+        Arguments() : values(nullptr), count(0) {}
+        Arguments(const Value* values, unsigned count) : values(values), count(count) {}
+        Arguments(const std::vector<Value>& values) : values(values.data()), count(unsigned(values.size())) {}
+        template<unsigned N>
+        Arguments(const Value (&values)[N]) : values(values), count(N) {}
+
+        unsigned size() const { return count; }
+        bool empty() const { return count == 0; }
+        const Value& operator[](unsigned index) const { return values[index]; }
+        const Value* begin() const { return values; }
+        const Value* end() const { return values + count; }
     };
+
+    // What a native function value points to, one of the two calling conventions
+    struct Native
+    {
+        Value::NativeFunction function = nullptr;
+        Value::VectorNativeFunction vectorFunction = nullptr;
+
+        Value call(VirtualMachine& vm, const Value& thisObject, Arguments args) const;
+    };
+
     struct GarbageCollected
     {
         enum State : char// Tri-color marking (incremental garbage collection)
@@ -757,11 +932,22 @@ namespace element
             GC_Black = 3,// used
 
             GC_Static = 4,// not part of garbage collection (constants)
+            GC_Free = 5,// an empty slot of a heap pool
+        };
+
+        enum Flags : char// Generations
+        {
+            GCF_Young = 1,// allocated in the nursery, promoted to the old space if a minor collection finds it used
+            GCF_Remembered = 2,// old and in the remembered set, it may point to young objects
+            GCF_Forwarded = 4,// young and promoted, 'next' points to the old copy
+            GCF_Static = 8,// a constant, like GC_Static but never written by the background sweep
+            GCF_Leaf = 16,// an array or object the marking found without managed values, until the write barrier sees one
         };
 
-        GarbageCollected* next;
+        GarbageCollected* next;// the old copy of a promoted object, or the next free slot
         Value::Type type;
         State state;
+        char flags;
 
         GarbageCollected(Value::Type type);
     };
@@ -791,23 +977,44 @@ namespace element
         Array();
     };
 
+    // Objects that got the same members in the same order share a shape. It maps
+    // the member hashes to slots in the objects and links to the shapes that the
+    // objects move to when a new member is added. An object that outgrows the
+    // shared shapes gets a dictionary shape of its own which is changed in place.
+    struct Shape
+    {
+        static const unsigned MaxSharedMembers = 32;
+        static const unsigned MaxLinearSearch = 8;
+
+        std::vector<unsigned> hashes;// the member hash of every slot, slot 0 is 'proto'
+        std::unordered_map<unsigned, unsigned> slotsByHash;// only used for bigger shapes
+        std::vector<std::pair<unsigned, Shape*>> transitions;// owned by this shape
+        bool dictionary;
+
+        Shape();
+        Shape(const Shape& parent, unsigned hash, bool dictionary);
+        Shape(const Shape&) = delete;
+        Shape& operator=(const Shape&) = delete;
+        ~Shape();
+
+        int findSlot(unsigned hash) const;
+        Shape* getTransition(unsigned hash);
+        void addMember(unsigned hash);// dictionary shapes only
+    };
+
     struct Object : public GarbageCollected
     {
-        struct Member
-        {
-            unsigned hash;
-            Value value;
-
-            Member();
-            explicit Member(unsigned hash);
-            Member(unsigned hash, const Value& value);
-            bool operator<(const Member& o) const;
-            bool operator==(const Member& o) const;
-        };
+        Shape* shape;
+        std::vector<Value> slots;// the member values in the order given by the shape
 
-        std::vector<Member> members;
+        Object(Shape* rootShape);
+        ~Object();
 
-        Object();
+        unsigned membersCount() const;
+        unsigned memberHash(unsigned slot) const;
+        std::vector<unsigned> slotsInHashOrder() const;// the order in which members are listed
+        int findSlot(unsigned hash) const;
+        void addMember(unsigned hash, const Value& value);
     };
 
     struct Box : public GarbageCollected
@@ -827,31 +1034,87 @@ namespace element
         Function(const Function* o);
     };
 
+    // The gray objects, last in first out, in chunks that are allocated as the stack
+    // grows and kept as it shrinks, so that marking never moves the pointers around.
+    class MarkStack
+    {
+        public:
+            static constexpr size_t ChunkSize = 1022;// a chunk takes 8 KB
+
+            MarkStack();
+            ~MarkStack();
+            MarkStack(const MarkStack&) = delete;
+            MarkStack& operator=(const MarkStack&) = delete;
+
+            bool empty() const { return m_count == 0; }// the top chunk is only empty if it is the last
+
+            GarbageCollected* back() const { return m_top->objects[m_count - 1]; }
+
+            void push(GarbageCollected* gc)
+            {
+                if(m_count == ChunkSize)
+                    addChunk();
+
+                m_top->objects[m_count++] = gc;
+            }
+
+            GarbageCollected* pop()
+            {
+                GarbageCollected* gc = m_top->objects[--m_count];
+
+                if(m_count == 0 && m_top->below)
+                    removeChunk();
+
+                return gc;
+            }
+
+            void clear();
+
+        private:
+            struct Chunk
+            {
+                Chunk* below;
+                GarbageCollected* objects[ChunkSize];
+            };
+
+            Chunk* m_top;
+            Chunk* m_spare;// the last chunk emptied, so a stack going up and down at a chunk's edge does not allocate
+            size_t m_count;// objects in the top chunk
+
+            void addChunk();
+            void removeChunk();
+    };
+
     struct IteratorImplementation
     {
+        // the built-in iterators are advanced inline by the 'for' loops
+        enum Kind
+        {
+            IK_Generic,
+            IK_Array,
+            IK_String,
+            IK_Range,
+        };
+
+        IteratorImplementation(Kind kind = IK_Generic) : kind(kind) {}
         virtual ~IteratorImplementation() = default;
-        virtual void updateGrayList(std::deque<GarbageCollected*>& grayList, GarbageCollected::State currentWhite)
+        virtual void updateGrayList(MarkStack& grayList, GarbageCollected::State currentWhite)
         {
             (void)grayList;
             (void)currentWhite;
         };
+        virtual void promoteYoung(MemoryManager& memoryManager)// the values above are done by the memory manager
+        {
+            (void)memoryManager;
+        };
+        virtual IteratorImplementation* moveTo(void* storage) = 0;// into the iterator that a young one is promoted to
 
+        Kind kind;
         Value thisObjectUsed;
         Value hasNextFunction;
         Value getNextFunction;
     };
 
-    struct Iterator : public GarbageCollected
-    {
-        Iterator(IteratorImplementation* implementation);
-        ~Iterator();
-
-        // The implementation has virtual methods and thus creates virtual tables.
-        // For this reason it cannot be a derived struct of the 'Iterator' struct
-        // because it will mess up the expected memory layout.
-        IteratorImplementation* implementation;
-    };
-
     struct ArrayIterator : public IteratorImplementation
     {
         Array* array;
@@ -860,7 +1123,9 @@ namespace element
 
         ArrayIterator(Array* array);
 
-        virtual void updateGrayList(std::deque<GarbageCollected*>& grayList, GarbageCollected::State currentWhite) override;
+        virtual void updateGrayList(MarkStack& grayList, GarbageCollected::State currentWhite) override;
+        virtual void promoteYoung(MemoryManager& memoryManager) override;
+        virtual IteratorImplementation* moveTo(void* storage) override;
     };
 
     struct StringIterator : public IteratorImplementation
@@ -871,21 +1136,67 @@ namespace element
 
         StringIterator(String* str);
 
-        virtual void updateGrayList(std::deque<GarbageCollected*>& grayList, GarbageCollected::State currentWhite) override;
+        virtual void updateGrayList(MarkStack& grayList, GarbageCollected::State currentWhite) override;
+        virtual void promoteYoung(MemoryManager& memoryManager) override;
+        virtual IteratorImplementation* moveTo(void* storage) override;
     };
 
     struct ObjectIterator : public IteratorImplementation
     {
         ObjectIterator(const Value& object, const Value& hasNext, const Value& getNext);
 
-        virtual void updateGrayList(std::deque<GarbageCollected*>& grayList, GarbageCollected::State currentWhite) override;
+        virtual void updateGrayList(MarkStack& grayList, GarbageCollected::State currentWhite) override;
+        virtual IteratorImplementation* moveTo(void* storage) override;
     };
 
     struct CoroutineIterator : public IteratorImplementation
     {
         CoroutineIterator(Function* coroutine);
 
-        virtual void updateGrayList(std::deque<GarbageCollected*>& grayList, GarbageCollected::State currentWhite) override;
+        virtual void updateGrayList(MarkStack& grayList, GarbageCollected::State currentWhite) override;
+        virtual IteratorImplementation* moveTo(void* storage) override;
+    };
+
+    struct RangeIterator : public IteratorImplementation
+    {
+        int from = 0;
+        int to = 0;
+        int step = 1;
+
+        RangeIterator();
+
+        virtual IteratorImplementation* moveTo(void* storage) override;
+    };
+
+    struct Iterator : public GarbageCollected
+    {
+        static constexpr size_t StorageSize = std::max({sizeof(ArrayIterator), sizeof(StringIterator), sizeof(ObjectIterator),
+                                                        sizeof(CoroutineIterator), sizeof(RangeIterator)});
+
+        Iterator();
+        ~Iterator();
+
+        // The implementation has virtual methods and thus creates virtual tables.
+        // For this reason it cannot be a derived struct of the 'Iterator' struct
+        // because it will mess up the expected memory layout. It is made in the
+        // storage that follows instead, so both take a single allocation.
+        template<class T, class... Args>
+        T* emplace(Args&&... args)
+        {
+            static_assert(sizeof(T) <= StorageSize, "the iterator implementation does not fit the storage");
+
+            T* newImplementation = new(storage) T(std::forward<Args>(args)...);
+
+            implementation = newImplementation;
+
+            if(implementation->thisObjectUsed.isNil())
+                implementation->thisObjectUsed = Value(this);
+
+            return newImplementation;
+        }
+
+        IteratorImplementation* implementation;
+        alignas(IteratorImplementation) char storage[StorageSize];
     };
 
     struct SourceCodeLine
@@ -904,28 +1215,100 @@ namespace element
         std::unique_ptr<char[]> bytecode;
     };
 
+    // Remembers where the member used by a LoadMember, StoreMember or PopStoreMember
+    // instruction was found for the last few shapes of the accessed objects
+    struct InlineCache
+    {
+        static const int MaxEntries = 4;// more receiver shapes than this make it megamorphic
+        static const int MaxProtoDepth = 2;// members found deeper in the proto chain are not cached
+
+        enum Kind : char
+        {
+            IC_Load,
+            IC_Store,
+        };
+
+        struct Entry
+        {
+            const Shape* shape;// the shape of the accessed object
+            Shape* newShape;// stores only, the shape after adding the member, nullptr when it already exists
+            const Object* protos[MaxProtoDepth];// the proto chain down to the object holding the member
+            const Shape* protoShapes[MaxProtoDepth];
+            int depth;// 0 when the accessed object itself holds the member
+            unsigned slot;
+        };
+
+        Entry entries[MaxEntries];
+        unsigned hash;
+        unsigned instructionIndex;
+        unsigned hits;
+        unsigned misses;
+        int entriesCount;
+        Kind kind;
+        bool megamorphic;
+
+        InlineCache(Kind kind, unsigned instructionIndex);
+
+        const char* stateName() const;
+    };
+
     struct CodeObject
     {
         std::vector<Instruction> instructions;
         Module* module;
         int localVariablesCount;
         int namedParametersCount;
+        int maxStackDepth;// the most operands the function can have on the stack at once
         std::vector<int> closureMapping;
         std::vector<SourceCodeLine> instructionLines;
+        // the opcode handlers of the instructions, decoded by the VM on the first run
+        mutable std::vector<const void*> handlers;
+        // one per member access instruction, the instruction A operand is the index
+        mutable std::vector<InlineCache> inlineCaches;
 
         CodeObject();
         CodeObject(CodeObject&& o) = default;
-        CodeObject(Instruction* instructions, unsigned instructionsSize, SourceCodeLine* lines, unsigned linesSize, int localVariablesCount, int namedParametersCount);
+        CodeObject(Instruction* instructions, unsigned instructionsSize, SourceCodeLine* lines, unsigned linesSize, int localVariablesCount, int namedParametersCount, int maxStackDepth);
+    };
+
+    // The value stack of an execution context, with the locals and the operands of
+    // all of its frames. A frame reserves room for its locals and for the deepest
+    // its operands can go when it is pushed, so that the VM can then push and pop
+    // by moving 'top' without checking the capacity.
+    struct ValueStack
+    {
+        std::vector<Value> values;// the memory of the stack, the values from 'top' on are unused
+        Value* top = nullptr;
+
+        ValueStack() = default;
+        ValueStack(const ValueStack&) = delete;
+        ValueStack& operator=(const ValueStack&) = delete;
+
+        Value* bottom() { return values.data(); }
+        unsigned size() const { return unsigned(top - values.data()); }
+        bool empty() const { return top == values.data(); }
+
+        Value& back() { return top[-1]; }
+        void push(const Value& value) { *top++ = value; }
+        void pop() { --top; }
+
+        void resize(unsigned newSize);// the room for it must have been reserved
+        void reserve(unsigned count);// room for 'count' more values, this may move the stack
     };
 
+    // A frame is a window on the value stack of its execution context: the local
+    // variables start at 'base' with the named parameters first, the anonymous
+    // arguments follow them and the operands of the frame are pushed after that.
     struct StackFrame
     {
         Function* function = nullptr;
         const Instruction* ip = nullptr;
         const Instruction* instructions = nullptr;
         std::vector<Value>* globals = nullptr;
-        std::vector<Value> variables;
-        Array anonymousParameters;
+        unsigned base = 0;
+        unsigned anonymousBase = 0;
+        int anonymousCount = 0;
+        Array* anonymousParameters = nullptr;// the $$ array, made the first time it is used
         Value thisObject;
     };
 
@@ -940,9 +1323,12 @@ namespace element
 
         State state = CRS_NotStarted;
         ExecutionContext* parent = nullptr;
+        ExecutionContext* caller = nullptr;// for root contexts, the context of the native that called back into the script
         Value lastObject;
-        std::deque<StackFrame> stackFrames;// this needs to be a deque, because things keep references to it
-        std::vector<Value> stack;
+        std::vector<StackFrame> stackFrames;// pushing a frame invalidates pointers to the others
+        ValueStack stack;
+        unsigned scannedFrames = 0;// the stack barrier, the frames below it are marked and did not run since
+        unsigned scanCycle = 0;// the collector cycle the barrier belongs to
     };
 
     std::string bytecodeSymbolsToString(const char* bytecode);
@@ -990,7 +1376,7 @@ namespace element
             std::string m_laststring;
             int m_lastinteger;
             int m_lastargidx;
-            float m_lastfloat;
+            double m_lastfloat;
             bool m_lastbool;
             bool m_muststartover;
 
@@ -1007,7 +1393,7 @@ namespace element
             const std::string& GetLastString() const;
             int getLastInteger() const;
             int getLastArgIndex() const;
-            float getLastFloat() const;
+            double getLastFloat() const;
             bool getLastBool() const;
 
         protected:
@@ -1137,6 +1523,59 @@ namespace element
             void resetState();
     };
 
+    // Runs between the semantic analysis and the compilation. It folds the operators
+    // whose operands are all literals, and replaces the loads of the variables that are
+    // stored only once, from a literal, by that literal. The folding follows the VM's
+    // operators exactly; whatever would overflow or fail is left to run as it did.
+    class Optimizer
+    {
+        private:
+            // the function owning a local variable and its index, no function for globals
+            using VariableKey = std::pair<const ast::FunctionNode*, int>;
+
+            std::map<VariableKey, int> m_storescount;
+            std::map<VariableKey, std::shared_ptr<ast::Node>> m_constvars;
+            const ast::FunctionNode* m_currfuncnode;
+
+        protected:
+            void countStores(const std::shared_ptr<ast::Node>& node);
+            void countStoreTarget(const std::shared_ptr<ast::Node>& target);
+            void optimizeNode(std::shared_ptr<ast::Node>& node);
+            void optimizeBlock(const std::shared_ptr<ast::BlockNode>& n);
+            bool propagatedKey(const std::shared_ptr<ast::Node>& node, VariableKey* key) const;
+            std::shared_ptr<ast::Node> foldUnaryOperator(const std::shared_ptr<ast::UnaryOperatorNode>& n) const;
+            std::shared_ptr<ast::Node> foldBinaryOperator(const std::shared_ptr<ast::BinaryOperatorNode>& n) const;
+
+        public:
+            Optimizer();
+            void optimize(const std::shared_ptr<ast::FunctionNode>& node);
+    };
+
+    // The old objects of one type, in slabs of equally sized slots. The sweep walks
+    // the slabs in order, and the free slots are chained through 'next'.
+    struct HeapPool
+    {
+        static constexpr size_t SlabSize = 64 * 1024;
+
+        Value::Type type;
+        size_t slotSize;
+        size_t slotsPerSlab;
+        std::vector<char*> slabs;
+        GarbageCollected* freeList;
+        size_t freeSlots;
+
+        HeapPool(Value::Type type, size_t objectSize);
+        ~HeapPool();
+        HeapPool(const HeapPool&) = delete;
+        HeapPool& operator=(const HeapPool&) = delete;
+
+        void* allocate();
+        void release(GarbageCollected* gc);// after the object is destroyed
+        void clear();// every slot must be free
+        GarbageCollected* slot(size_t slab, size_t index) const { return (GarbageCollected*)(slabs[slab] + index * slotSize); }
+        size_t slotsCount() const { return slabs.size() * slotsPerSlab; }
+    };
+
     class MemoryManager
     {
         public:
@@ -1145,25 +1584,76 @@ namespace element
                 GCS_Ready = 0,
                 GCS_MarkRoots = 1,
                 GCS_Mark = 2,
-                GCS_SweepHead = 3,
-                GCS_SweepRest = 4,
+                GCS_Remark = 3,
+            };
+
+            static constexpr int PoolsCount = Value::VT_Error - Value::VT_String + 1;// one for each managed type
+
+            // The slabs of one pool as they were when the marking ended. The sweeper
+            // thread owns them until it is joined, the pool carries on with new slabs.
+            struct SweptSegment
+            {
+                std::vector<char*> slabs;
+                std::vector<char*> keptSlabs;// the slabs that still hold objects, the others are deleted
+                GarbageCollected* freeList = nullptr;
+                GarbageCollected* freeTail = nullptr;
+                size_t freeSlots = 0;
+                std::atomic<int> freedObjects = 0;// not taken off the heap counters yet
             };
 
+            // the pacing defaults, see setGCGrowth and setGCStepSize
+            static constexpr int DefaultGCGrowth = 200;
+            static constexpr int DefaultGCStepSize = 400;
+            static constexpr size_t MinGCAllowance = 256 * 1024;// bytes allocated before the first cycle
+            static constexpr size_t GCStepBytes = 8;// bytes of allocation paid for by one unit of work
+            static constexpr size_t NurserySize = 1024 * 1024;// bytes allocated by the young objects between minor collections
+            static constexpr size_t MarkShareSize = 64;// gray objects a marker thread keeps to itself before sharing the rest
+
         private:
-            GarbageCollected* m_heaphead;
+            HeapPool m_pools[PoolsCount];// the old space, by type
             GCStage m_gcstage;
             GarbageCollected::State m_currentwhite;
             GarbageCollected::State m_nextwhite;
-            std::deque<GarbageCollected*> m_graylist;
-            GarbageCollected* m_prevgc;
-            GarbageCollected* m_currgc;
+            MarkStack m_graylist;
+            SweptSegment m_swept[PoolsCount];// handed to the sweeper thread
+            std::thread m_sweeper;
+            std::atomic<bool> m_sweepdone;
+            unsigned m_gccycle;// counts the major cycles, the stack barriers of older ones are void
+            std::vector<std::vector<Value>*> m_rootglobals;// the roots being scanned, see takeRoots
+            std::vector<ExecutionContext*> m_rootcontexts;
+            size_t m_rootglobal;// where the scan of the roots is
+            size_t m_rootvalue;
+            size_t m_rootcontext;
+            Shape m_rootshape;// the shape of the empty object, root of all shared shapes
 
             // memory roots
             Module m_defmodule;
             std::unordered_map<std::string, Module> m_modules;
             std::vector<ExecutionContext*> m_excontexts;
+            std::vector<ExecutionContext*> m_freecontexts;// root contexts kept for reuse, with their stacks
+            ExecutionContext* const* m_runningcontext;// running coroutines are only reachable from here
+            std::vector<Value*> m_temproots;// C++ locals of natives that call back into scripts
+            std::vector<Function*> m_grayagain;// coroutines whose stacks are marked again before the sweep
+
+            // young generation, only allocated from between the major cycles
+            char* m_nursery;// bump allocated, emptied by every minor collection
+            char* m_nurserytop;
+            char* m_nurseryend;
+            size_t m_nurserybytes;// the memory held by the young objects
+            bool m_minordue;
+            std::vector<GarbageCollected*> m_remembered;// old objects that may point to young ones
+            std::vector<GarbageCollected*> m_promoted;// promoted objects whose references are not promoted yet
+
+            // allocation pacing
+            int64_t m_gcdebt;// bytes allocated past the allowance of the heap, steps run while it is positive
+            size_t m_livebytes;// size of the heap that survived the last cycle
+            size_t m_markedbytes;// size of the objects the running cycle has marked
+            int m_gcgrowth;// percent of the live size the heap may grow to before a new cycle
+            int m_gcstepsize;// units of work done by one incremental step
+            int m_markthreads;// threads marking in the full collections
 
             // statistics
+            uint64_t m_allocationscnt;// every object made, young or old
             int m_heapstringscnt;
             int m_heaparrayscnt;
             int m_heapobjectscnt;
@@ -1174,16 +1664,28 @@ namespace element
 
         protected:
             void deleteHeap();
+            template<class T, class... Args> T* allocate(Args&&... args);
+            template<class T, class... Args> T* allocateOld(Args&&... args);
             void addToHeap(GarbageCollected* gc);
             void freeGC(GarbageCollected* gc);
+            Iterator* makeIterator();// without an implementation yet
+            void collectYoung();
+            void promoteRoots();
+            void promoteExecutionContext(ExecutionContext* context);
+            void promoteContextChain(ExecutionContext* context);
+            void promoteReferences(GarbageCollected* gc);
+            GarbageCollected* moveObject(GarbageCollected* gc);// into the old space, leaving a forwarding shell
             void makeGrayIfNeeded(GarbageCollected* gc, int* steps);
+            bool markExecutionContext(ExecutionContext* context, int* steps);
+            void takeRoots();
             int markRoots(int steps);
             int mark(int steps);
-            int sweepHead(int steps);
-            int sweepRest(int steps);
+            void remark();
+            void parallelMark();
+            void startSweep();
 
         public:
-            MemoryManager();
+            MemoryManager(int markThreads = 1);
             ~MemoryManager();
             void resetState();
             Module& getDefaultModule();
@@ -1198,21 +1700,70 @@ namespace element
             Function* makeCoroutine(const Function* other);
             Box* makeBox();
             Box* makeBox(const Value& value);
-            Iterator* makeIterator(IteratorImplementation* newIterator);
+            template<class T, class... Args>
+            Iterator* makeIterator(Args&&... args)
+            {
+                Iterator* newIterator = makeIterator();
+                newIterator->emplace<T>(std::forward<Args>(args)...);
+                return newIterator;
+            }
             Error* makeError(const std::string& errorMessage);
             ExecutionContext* makeRootExecutionContext();
             bool deleteRootExecutionContext(ExecutionContext* context);
             void collectGarbage(int steps = std::numeric_limits<int>::max());
+            void finishSweep();
+            int compactHeap();// returns how many objects were moved
+            bool collectionDue() const { return m_gcdebt > 0 || m_minordue; }
+            void stepGarbageCollection();
+            void setGCGrowth(int percent);
+            void setGCStepSize(int steps);
+            int getGCGrowth() const;
+            int getGCStepSize() const;
+            int getMarkThreads() const;
+            size_t liveHeapBytes() const;
+            size_t slabBytes() const;
+            size_t usedSlotsCount() const;
+            size_t freeSlotsCount() const;
+            uint64_t allocationsCount() const;
+            void setRunningContext(ExecutionContext* const* context);
+            void pushTemporaryRoot(Value* value);
+            void popTemporaryRoots(unsigned count);
             void updateGCRelationship(GarbageCollected* parent, const Value& child);
+            void rememberObject(GarbageCollected* gc);
+            GarbageCollected* promoteYoung(GarbageCollected* gc);
+            void promoteYoung(Value& value);
             int heapObjectsCount(Value::Type type) const;
     };
 
+    // Keeps values that only a native's C++ locals refer to alive while the native
+    // calls back into script code, where the collector may run. The locals can be
+    // reassigned freely, it is their current value that is kept, and they are
+    // updated when a minor collection or a compaction moves what they point to.
+    struct TemporaryRoots
+    {
+        MemoryManager& memoryManager;
+        unsigned count;
+
+        TemporaryRoots(MemoryManager& memoryManager, std::initializer_list<Value*> values)
+        : memoryManager(memoryManager), count(unsigned(values.size()))
+        {
+            for(Value* value : values)
+                memoryManager.pushTemporaryRoot(value);
+        }
+
+        ~TemporaryRoots() { memoryManager.popTemporaryRoots(count); }
+
+        TemporaryRoots(const TemporaryRoots&) = delete;
+        TemporaryRoots& operator=(const TemporaryRoots&) = delete;
+    };
+
     class VirtualMachine
     {
         private:
             Logger m_logger;
             Parser m_parser;
             SemanticAnalyzer m_analyzer;
+            Optimizer m_optimizer;
             Compiler m_compiler;
             FileManager m_fileman;
             MemoryManager m_memoryman;
@@ -1221,16 +1772,19 @@ namespace element
             std::deque<String> m_conststrings;
             std::deque<Function> m_constfunctions;
             std::deque<CodeObject> m_constcodeobjects;
-            std::vector<Value::NativeFunction> m_natfuncs;
+            std::deque<Native> m_natives;
+            std::vector<Value> m_natfuncs;// the values of m_natives by index
             std::unordered_map<unsigned, std::string> m_symnames;
             ExecutionContext* m_execctx;
-            std::vector<Value>* m_stack;
+            ExecutionContext m_basectx;// the caller of the first script
+            ValueStack* m_stack;
             std::string m_errmessage;
+            int m_optlevel;
 
         protected:
             Value execBytecode(const char* bytecode, Module& forModule);
             int parseBytecode(const char* bytecode, Module& forModule);
-            Value commonCallFunction(const Value& thisObject, const Value& function, const std::vector<Value>& args);
+            Value commonCallFunction(const Value& thisObject, const Value& function, Arguments args);
             Value runCode();
             void frameRunCode(StackFrame* frame);
             void call(int argumentsCount);
@@ -1241,13 +1795,15 @@ namespace element
             void arrayStoreElement(Array* array, int index, const Value& newValue);
             void loadMemberFromObject(Object* object, unsigned hash, Value* outValue) const;
             void objectStoreMember(Object* object, unsigned hash, const Value& newValue);
+            void cachedLoadMember(InlineCache& cache, Object* object, unsigned hash, Value* outValue);
+            void cachedStoreMember(InlineCache& cache, Object* object, unsigned hash, const Value& newValue);
             bool doBinaryOperation(int opCode);
             void registerBuiltins();
             void logStacktraceFrom(const StackFrame* frame);
             void locationFromFrame(const StackFrame* frame, int* currentLine, std::string* currentFile) const;
 
         public:
-            VirtualMachine();
+            VirtualMachine(int markThreads = 1);
             void resetState();
             Value evalStream(std::istream& input);
             Value evalFile(const std::string& filename);
@@ -1257,7 +1813,10 @@ namespace element
             bool hasError() const;
             void clearError();
             void addNative(const std::string& name, Value::NativeFunction function);
+            void addNative(const std::string& name, Value::VectorNativeFunction function);
             std::string getVersion() const;
+            void setOptimizationLevel(int level);
+            void setBackend(Compiler::Backend backend);
             // value manipulation //////////////////////////////////////////////////////
             Iterator* makeIterator(const Value& value);
             unsigned hashFromName(const std::string& name);
@@ -1268,12 +1827,13 @@ namespace element
             void setMember(const Value& object, unsigned memberHash, const Value& value);
             void pushElement(const Value& array, const Value& value);
             void addElement(const Value& array, int atIndex, const Value& value);
-            Value callFunction(const Value& function, const std::vector<Value>& args);
-            Value callMemberFunction(const Value& object, const std::string& memberFunctionName, const std::vector<Value>& args);
-            Value callMemberFunction(const Value& object, unsigned functionHash, const std::vector<Value>& args);
-            Value callMemberFunction(const Value& object, const Value& function, const std::vector<Value>& args);
+            Value callFunction(const Value& function, Arguments args);
+            Value callMemberFunction(const Value& object, const std::string& memberFunctionName, Arguments args);
+            Value callMemberFunction(const Value& object, unsigned functionHash, Arguments args);
+            Value callMemberFunction(const Value& object, const Value& function, Arguments args);
 
             void addGlobal(const std::string& name, const Value& v);
+            Value inlineCacheStats();
         };
 
     namespace Builtins
@@ -1286,45 +1846,48 @@ namespace element
 
         const std::vector<NamedFunction>& GetAllFunctions();
 
-        Value natfn_loadelement(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_addsearchpath(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_getsearchpaths(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_clearsearchpaths(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_type(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_thiscall(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_garbagecollect(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_memorystats(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_print(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_toupper(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_tolower(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_keys(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_makeerror(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_iserror(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_makecoroutine(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_makeiterator(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_iteratorhasnext(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_iteratorgetnext(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_range(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_each(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_times(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_count(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_map(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_filter(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_reduce(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_all(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_any(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_min(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_max(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_sort(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_abs(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_floor(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_ceil(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_round(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_sqrt(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_sin(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_cos(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_tan(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
-        Value natfn_chr(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args);
+        Value natfn_loadelement(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_addsearchpath(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_getsearchpaths(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_clearsearchpaths(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_type(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_thiscall(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_garbagecollect(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_garbagecollectpacing(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_garbagecompact(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_memorystats(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_inlinecachestats(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_print(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_toupper(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_tolower(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_keys(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_makeerror(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_iserror(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_makecoroutine(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_makeiterator(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_iteratorhasnext(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_iteratorgetnext(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_range(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_each(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_times(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_count(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_map(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_filter(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_reduce(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_all(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_any(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_min(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_max(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_sort(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_abs(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_floor(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_ceil(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_round(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_sqrt(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_sin(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_cos(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_tan(VirtualMachine& vm, const Value& thisObject, Arguments args);
+        Value natfn_chr(VirtualMachine& vm, const Value& thisObject, Arguments args);
 
     }// namespace Builtins
 
@@ -3,7 +3,7 @@
 
 namespace element
 {
-    GarbageCollected::GarbageCollected(Value::Type type) : next(nullptr), type(type), state(GC_White0)
+    GarbageCollected::GarbageCollected(Value::Type type) : next(nullptr), type(type), state(GC_White0), flags(0)
     {
     }
 
@@ -35,32 +35,115 @@ namespace element
     {
     }
 
-    Object::Member::Member() : hash(0)
+    Shape::Shape() : hashes(1, Symbol::ProtoHash), dictionary(false)// only the 'proto' member
     {
     }
 
-    Object::Member::Member(unsigned hash) : hash(hash)
+    Shape::Shape(const Shape& parent, unsigned hash, bool dictionary)
+    : hashes(parent.hashes), slotsByHash(parent.slotsByHash), dictionary(dictionary)
     {
+        addMember(hash);
     }
 
-    Object::Member::Member(unsigned hash, const Value& value) : hash(hash), value(value)
+    Shape::~Shape()
     {
+        for(auto& transition : transitions)
+            delete transition.second;
     }
 
-    bool Object::Member::operator<(const Member& o) const
+    int Shape::findSlot(unsigned hash) const
     {
-        return hash < o.hash;
+        if(hashes.size() <= MaxLinearSearch)
+        {
+            for(unsigned i = 0; i < hashes.size(); ++i)
+                if(hashes[i] == hash)
+                    return int(i);
+
+            return -1;
+        }
+
+        auto it = slotsByHash.find(hash);
+
+        return it != slotsByHash.end() ? int(it->second) : -1;
+    }
+
+    Shape* Shape::getTransition(unsigned hash)
+    {
+        for(auto& transition : transitions)
+            if(transition.first == hash)
+                return transition.second;
+
+        Shape* shape = new Shape(*this, hash, false);
+
+        transitions.emplace_back(hash, shape);
+
+        return shape;
     }
 
-    bool Object::Member::operator==(const Member& o) const
+    void Shape::addMember(unsigned hash)
     {
-        return hash == o.hash;
+        hashes.push_back(hash);
+
+        if(hashes.size() == MaxLinearSearch + 1)// switching to the hash map
+        {
+            for(unsigned i = 0; i < hashes.size(); ++i)
+                slotsByHash[hashes[i]] = i;
+        }
+        else if(hashes.size() > MaxLinearSearch)
+        {
+            slotsByHash[hash] = unsigned(hashes.size() - 1);
+        }
     }
 
-    Object::Object() : GarbageCollected(Value::VT_Object), members(1)// at least a 'proto' member
+    Object::Object(Shape* rootShape) : GarbageCollected(Value::VT_Object), shape(rootShape), slots(1)// the 'proto' member
     {
     }
 
+    Object::~Object()
+    {
+        if(shape->dictionary)
+            delete shape;
+    }
+
+    unsigned Object::membersCount() const
+    {
+        return unsigned(slots.size());
+    }
+
+    unsigned Object::memberHash(unsigned slot) const
+    {
+        return shape->hashes[slot];
+    }
+
+    std::vector<unsigned> Object::slotsInHashOrder() const
+    {
+        std::vector<unsigned> order(slots.size());
+
+        for(unsigned i = 0; i < order.size(); ++i)
+            order[i] = i;
+
+        std::sort(order.begin(), order.end(), [this](unsigned a, unsigned b) { return memberHash(a) < memberHash(b); });
+
+        return order;
+    }
+
+    int Object::findSlot(unsigned hash) const
+    {
+        return shape->findSlot(hash);
+    }
+
+    void Object::addMember(unsigned hash, const Value& value)
+    {
+        if(shape->dictionary)
+            shape->addMember(hash);
+        else if(shape->hashes.size() >= Shape::MaxSharedMembers)
+            shape = new Shape(*shape, hash, true);
+        else
+            shape = shape->getTransition(hash);
+
+        slots.push_back(value);
+    }
+
     Box::Box() : GarbageCollected(Value::VT_Box)
     {
     }
@@ -75,68 +158,94 @@ namespace element
     {
     }
 
-    Iterator::Iterator(IteratorImplementation* implementation)
-    : GarbageCollected(Value::VT_Iterator), implementation(implementation)
+    Iterator::Iterator() : GarbageCollected(Value::VT_Iterator), implementation(nullptr)
     {
-        if(implementation->thisObjectUsed.isNil())
-            implementation->thisObjectUsed = Value(this);
     }
 
     Iterator::~Iterator()
     {
-        delete implementation;// virtual call
+        if(implementation)
+            implementation->~IteratorImplementation();// virtual call
     }
 
-    ArrayIterator::ArrayIterator(Array* array) : array(array)
+    ArrayIterator::ArrayIterator(Array* array) : IteratorImplementation(IK_Array), array(array)
     {
-        hasNextFunction = Value(
-        [](VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args) -> Value
+        static const Native hasNext = {
+        [](VirtualMachine& vm, const Value& thisObject, Arguments args) -> Value
         {
-            ArrayIterator* self = static_cast<ArrayIterator*>(thisObject.iterator->implementation);
+            ArrayIterator* self = static_cast<ArrayIterator*>(thisObject.iterator()->implementation);
 
             return self->currentIndex < self->array->elements.size();
-        });
+        }};
+
+        hasNextFunction = Value(&hasNext);
 
-        getNextFunction = Value(
-        [](VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args) -> Value
+        static const Native getNext = {
+        [](VirtualMachine& vm, const Value& thisObject, Arguments args) -> Value
         {
-            ArrayIterator* self = static_cast<ArrayIterator*>(thisObject.iterator->implementation);
+            ArrayIterator* self = static_cast<ArrayIterator*>(thisObject.iterator()->implementation);
 
             return self->array->elements[self->currentIndex++];
-        });
+        }};
+
+        getNextFunction = Value(&getNext);
     }
 
-    void ArrayIterator::updateGrayList(std::deque<GarbageCollected*>& grayList, GarbageCollected::State currentWhite)
+    void ArrayIterator::updateGrayList(MarkStack& grayList, GarbageCollected::State currentWhite)
     {
         if(array->state == currentWhite)
-            grayList.push_back(array);
+            grayList.push(array);
     }
 
-    StringIterator::StringIterator(String* str) : str(str)
+    void ArrayIterator::promoteYoung(MemoryManager& memoryManager)
     {
-        hasNextFunction = Value(
-        [](VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args) -> Value
+        array = (Array*)memoryManager.promoteYoung(array);
+    }
+
+    IteratorImplementation* ArrayIterator::moveTo(void* storage)
+    {
+        return new(storage) ArrayIterator(*this);
+    }
+
+    StringIterator::StringIterator(String* str) : IteratorImplementation(IK_String), str(str)
+    {
+        static const Native hasNext = {
+        [](VirtualMachine& vm, const Value& thisObject, Arguments args) -> Value
         {
-            StringIterator* self = static_cast<StringIterator*>(thisObject.iterator->implementation);
+            StringIterator* self = static_cast<StringIterator*>(thisObject.iterator()->implementation);
 
             return self->currentIndex < self->str->str.size();
-        });
+        }};
 
-        getNextFunction = Value(
-        [](VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args) -> Value
+        hasNextFunction = Value(&hasNext);
+
+        static const Native getNext = {
+        [](VirtualMachine& vm, const Value& thisObject, Arguments args) -> Value
         {
-            StringIterator* self = static_cast<StringIterator*>(thisObject.iterator->implementation);
+            StringIterator* self = static_cast<StringIterator*>(thisObject.iterator()->implementation);
 
             char c = self->str->str[self->currentIndex++];
 
             return vm.getMemoryManager().makeString(&c, 1);
-        });
+        }};
+
+        getNextFunction = Value(&getNext);
     }
 
-    void StringIterator::updateGrayList(std::deque<GarbageCollected*>& grayList, GarbageCollected::State currentWhite)
+    void StringIterator::updateGrayList(MarkStack& grayList, GarbageCollected::State currentWhite)
     {
         if(str->state == currentWhite)
-            grayList.push_back(str);
+            grayList.push(str);
+    }
+
+    void StringIterator::promoteYoung(MemoryManager& memoryManager)
+    {
+        str = (String*)memoryManager.promoteYoung(str);
+    }
+
+    IteratorImplementation* StringIterator::moveTo(void* storage)
+    {
+        return new(storage) StringIterator(*this);
     }
 
     ObjectIterator::ObjectIterator(const Value& object, const Value& hasNext, const Value& getNext)
@@ -146,29 +255,71 @@ namespace element
         getNextFunction = getNext;
     }
 
-    void ObjectIterator::updateGrayList(std::deque<GarbageCollected*>& grayList, GarbageCollected::State currentWhite)
+    void ObjectIterator::updateGrayList(MarkStack& grayList, GarbageCollected::State currentWhite)
+    {
+        if(thisObjectUsed.object()->state == currentWhite)
+            grayList.push(thisObjectUsed.object());
+    }
+
+    IteratorImplementation* ObjectIterator::moveTo(void* storage)
     {
-        if(thisObjectUsed.object->state == currentWhite)
-            grayList.push_back(thisObjectUsed.object);
+        return new(storage) ObjectIterator(*this);
     }
 
     CoroutineIterator::CoroutineIterator(Function* coroutine)
     {
-        hasNextFunction = Value(
-        [](VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args) -> Value
+        static const Native hasNext = {
+        [](VirtualMachine& vm, const Value& thisObject, Arguments args) -> Value
         {
-            CoroutineIterator* self = static_cast<CoroutineIterator*>(thisObject.iterator->implementation);
+            CoroutineIterator* self = static_cast<CoroutineIterator*>(thisObject.iterator()->implementation);
 
-            return self->getNextFunction.function->executionContext->state != ExecutionContext::CRS_Finished;
-        });
+            return self->getNextFunction.function()->executionContext->state != ExecutionContext::CRS_Finished;
+        }};
+
+        hasNextFunction = Value(&hasNext);
 
         getNextFunction = coroutine;
     }
 
-    void CoroutineIterator::updateGrayList(std::deque<GarbageCollected*>& grayList, GarbageCollected::State currentWhite)
+    void CoroutineIterator::updateGrayList(MarkStack& grayList, GarbageCollected::State currentWhite)
+    {
+        if(getNextFunction.function()->state == currentWhite)
+            grayList.push(getNextFunction.function());
+    }
+
+    IteratorImplementation* CoroutineIterator::moveTo(void* storage)
+    {
+        return new(storage) CoroutineIterator(*this);
+    }
+
+    RangeIterator::RangeIterator() : IteratorImplementation(IK_Range)
+    {
+        static const Native hasNext = {
+        [](VirtualMachine& vm, const Value& thisObject, Arguments args) -> Value
+        {
+            RangeIterator* self = static_cast<RangeIterator*>(thisObject.iterator()->implementation);
+
+            return self->from < self->to;
+        }};
+
+        hasNextFunction = Value(&hasNext);
+
+        static const Native getNext = {
+        [](VirtualMachine& vm, const Value& thisObject, Arguments args) -> Value
+        {
+            RangeIterator* self = static_cast<RangeIterator*>(thisObject.iterator()->implementation);
+
+            int result = self->from;
+            self->from += self->step;
+            return result;
+        }};
+
+        getNextFunction = Value(&getNext);
+    }
+
+    IteratorImplementation* RangeIterator::moveTo(void* storage)
     {
-        if(getNextFunction.function->state == currentWhite)
-            grayList.push_back(getNextFunction.function);
+        return new(storage) RangeIterator(*this);
     }
 
 }// namespace element
@@ -157,7 +157,7 @@ namespace element
         return m_lastargidx;
     }
 
-    float Lexer::getLastFloat() const
+    double Lexer::getLastFloat() const
     {
         return m_lastfloat;
     }
@@ -178,7 +178,7 @@ namespace element
         m_laststring = "";
         m_lastinteger = 0;
         m_lastargidx = 0;
-        m_lastfloat = 0.0f;
+        m_lastfloat = 0.0;
         m_lastbool = false;
 
         m_muststartover = false;
@@ -417,7 +417,7 @@ namespace element
                 m_currch = getNextChar();
             }
 
-            m_lastfloat = std::stof(number);
+            m_lastfloat = std::stod(number);
             m_currtoken = T_Float;
             return true;
         }
@@ -20,6 +20,78 @@ int InterpretFile(element::VirtualMachine& vm, const char* fileString)
     return 0;
 }
 
+/*
+* runs the cases of a test file, each one starts at a line 'TEST_CASE name' and
+* passes when its result is true, or an error for the 'TEST_CASE MUST_BE_ERROR name' ones.
+* every case gets a new VM, made with the options of the command line.
+*/
+int InterpretTests(const char* fileString, int markThreads, int optimizationLevel,
+                   element::Compiler::Backend backend)
+{
+    std::ifstream file(fileString);
+
+    if(!file.is_open())
+    {
+        std::cout << "Could not open file: " << fileString << std::endl;
+        return 1;
+    }
+
+    const std::string caseTag = "TEST_CASE";
+    const std::string errorTag = "MUST_BE_ERROR";
+
+    std::vector<std::pair<std::string, std::string>> testCases;// name and code
+    std::string line;
+
+    while(std::getline(file, line))
+    {
+        if(line.compare(0, caseTag.size(), caseTag) == 0)
+        {
+            size_t nameStart = line.find_first_not_of(" \t", caseTag.size());
+            testCases.emplace_back(nameStart == std::string::npos ? "" : line.substr(nameStart), "");
+        }
+        else if(!testCases.empty())
+        {
+            testCases.back().second += line;
+            testCases.back().second += '\n';
+        }
+    }
+
+    int failedCount = 0;
+
+    for(const auto& testCase : testCases)
+    {
+        std::string name = testCase.first;
+        bool mustBeError = name.compare(0, errorTag.size(), errorTag) == 0;
+
+        element::VirtualMachine vm(markThreads);
+        vm.setOptimizationLevel(optimizationLevel);
+        vm.setBackend(backend);
+
+        std::stringstream code(testCase.second);
+        element::Value result = vm.evalStream(code);
+
+        bool passed = mustBeError ? result.isError() : !result.isError() && result.asBool();
+
+        if(passed)
+        {
+            std::cout << '.';
+        }
+        else
+        {
+            ++failedCount;
+
+            std::cout << "\nFailed test case: " << name << '\n';
+            if(result.isError() && !mustBeError)
+                std::cout << "with error:\n" << result.asString() << '\n';
+        }
+        std::cout.flush();
+    }
+
+    std::cout << '\n' << testCases.size() - failedCount << " of " << testCases.size() << " passed\n";
+
+    return failedCount > 0 ? 1 : 0;
+}
+
 
 #if !defined(NO_READLINE)
 /*
@@ -84,7 +156,8 @@ int InterpretREPL(element::VirtualMachine& vm)
 }
 #endif
 
-void DebugPrintFile(const char* fileString, bool ast, bool symbols, bool constants)
+static void DebugPrintPass(const char* fileString, bool ast, bool symbols, bool constants, int optimizationLevel,
+                           element::Compiler::Backend backend)
 {
     std::ifstream file(fileString);
 
@@ -105,10 +178,10 @@ void DebugPrintFile(const char* fileString, bool ast, bool symbols, bool constan
         return;
     }
 
-    if(ast)
+    if(ast && optimizationLevel == 0)
         std::cout << element::ast::nodeToString(node);
 
-    if(!(symbols || constants))
+    if(!(symbols || constants || (ast && optimizationLevel > 0)))
         return;
 
     element::SemanticAnalyzer semanticAnalyzer(logger);
@@ -125,7 +198,21 @@ void DebugPrintFile(const char* fileString, bool ast, bool symbols, bool constan
         return;
     }
 
+    if(optimizationLevel > 0)
+    {
+        element::Optimizer optimizer;
+        optimizer.optimize(node);
+
+        if(ast)
+            std::cout << element::ast::nodeToString(node);
+    }
+
+    if(!(symbols || constants))
+        return;
+
     element::Compiler compiler(logger);
+    compiler.setOptimizationLevel(optimizationLevel);
+    compiler.setBackend(backend);
 
     std::unique_ptr<char[]> bytecode = compiler.compile(node);
 
@@ -142,6 +229,20 @@ void DebugPrintFile(const char* fileString, bool ast, bool symbols, bool constan
         std::cout << element::bytecodeConstantsToString(bytecode.get());
 }
 
+// prints the code as it is written and then as it runs, when it gets optimized
+void DebugPrintFile(const char* fileString, bool ast, bool symbols, bool constants, int optimizationLevel,
+                    element::Compiler::Backend backend)
+{
+    if(optimizationLevel > 0)
+    {
+        std::cout << "// before the optimizations\n";
+        DebugPrintPass(fileString, ast, symbols, constants, 0, element::Compiler::CB_Stack);
+        std::cout << "// after the optimizations, level " << optimizationLevel << "\n";
+    }
+
+    DebugPrintPass(fileString, ast, symbols, constants, optimizationLevel, backend);
+}
+
 int main(int argc, char** argv)
 {
     const char* usage =(
@@ -153,15 +254,29 @@ int main(int argc, char** argv)
         "-ds           : debug print the generated symbols\n"
         "-dc           : debug print the constants\n"
         "-dr           : run the file after debug printing\n"
+        "-tN           : mark with N threads in the full garbage collections\n"
+        "-ON           : optimization level, 0 compiles the code as written (default 1)\n"
+        "-r            : compile to the register instructions instead of the stack ones\n"
+        "-t --test     : run in testing mode to execute unit tests\n"
     );
 
     bool printAst = false;
     bool printSymbols = false;
     bool printConstants = false;
     bool runAfterPrinting = false;
+    bool runTests = false;
+    int optimizationLevel = 1;
+    element::Compiler::Backend backend = element::Compiler::CB_Stack;
 
     const char* fileString = nullptr;
-    element::VirtualMachine vm;
+
+    // the VM is made with it, before the other options are read
+    int markThreads = 1;
+    for(int i = 1; i < argc && argv[i][0] == '-'; ++i)
+        if(argv[i][1] == 't' && argv[i][2] != '\0')// -tN
+            markThreads = std::max(atoi(argv[i] + 2), 1);
+
+    element::VirtualMachine vm(markThreads);
     {
         element::Value box = vm.getMemoryManager().makeBox();
         vm.addGlobal("mybox", box);
@@ -181,6 +296,23 @@ int main(int argc, char** argv)
                 if(strstr(argv[i], "r") != nullptr)
                     runAfterPrinting = true;
             }
+            else if(argv[i][1] == 't' && argv[i][2] == '\0')// -t
+            {
+                runTests = true;
+            }
+            else if(argv[i][1] == 't')// -tN, read above
+            {
+            }
+            else if(argv[i][1] == 'O')// -ON
+            {
+                optimizationLevel = std::max(atoi(argv[i] + 2), 0);
+                vm.setOptimizationLevel(optimizationLevel);
+            }
+            else if(argv[i][1] == 'r')// -r
+            {
+                backend = element::Compiler::CB_Registers;
+                vm.setBackend(backend);
+            }
             else if(argv[i][1] == 'v')// -v
             {
                 std::cout << vm.getVersion() << '\n';
@@ -203,6 +335,10 @@ int main(int argc, char** argv)
                     std::cout << usage << std::endl;
                     return 0;
                 }
+                else if(strstr(argv[i], "test") != nullptr)// --test
+                {
+                    runTests = true;
+                }
                 else
                 {
                     std::cout << usage << std::endl;
@@ -224,9 +360,12 @@ int main(int argc, char** argv)
 
     if(fileString)
     {
+        if(runTests)
+            return InterpretTests(fileString, markThreads, optimizationLevel, backend);
+
         if(printAst || printSymbols || printConstants)
         {
-            DebugPrintFile(fileString, printAst, printSymbols, printConstants);
+            DebugPrintFile(fileString, printAst, printSymbols, printConstants, optimizationLevel, backend);
 
             if(!runAfterPrinting)
                 return 0;
@@ -1,20 +1,276 @@
 #include "element.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <thread>
 
 namespace element
 {
-    MemoryManager::MemoryManager()
-    : m_heaphead(nullptr), m_gcstage(GCS_Ready), m_currentwhite(GarbageCollected::GC_White0),
-      m_nextwhite(GarbageCollected::GC_White1), m_prevgc(nullptr), m_currgc(nullptr), m_heapstringscnt(0),
-      m_heaparrayscnt(0), m_heapobjectscnt(0), m_heapfunctionscnt(0), m_heapboxescnt(0), m_heapitercnt(0),
-      m_heaperrorscnt(0)
+    // An estimate of the memory an object holds, for pacing the collector
+    static size_t heapSize(const GarbageCollected* gc)
     {
+        switch(gc->type)
+        {
+            case Value::VT_String:
+                return sizeof(String) + ((const String*)gc)->str.capacity();
+
+            case Value::VT_Array:
+                return sizeof(Array) + ((const Array*)gc)->elements.capacity() * sizeof(Value);
+
+            case Value::VT_Object:
+                return sizeof(Object) + ((const Object*)gc)->slots.capacity() * sizeof(Value);
+
+            case Value::VT_Function:
+            {
+                const Function* function = (const Function*)gc;
+                size_t size = sizeof(Function) + function->freeVariables.capacity() * sizeof(Box*);
+
+                if(function->executionContext)
+                    size += sizeof(ExecutionContext) + function->executionContext->stack.values.capacity() * sizeof(Value) +
+                            function->executionContext->stackFrames.capacity() * sizeof(StackFrame);
+                return size;
+            }
+
+            case Value::VT_Box:
+                return sizeof(Box);
+
+            case Value::VT_Iterator:
+                return sizeof(Iterator);// the implementation is inside
+
+            case Value::VT_Error:
+                return sizeof(Error) + ((const Error*)gc)->errorString.capacity();
+
+            default:
+                return 0;
+        }
+    }
+
+    // The room an object takes in the nursery, where they follow each other
+    static size_t youngSize(size_t size)
+    {
+        return (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+    }
+
+    static size_t youngSize(const GarbageCollected* gc)
+    {
+        switch(gc->type)
+        {
+            case Value::VT_String:
+                return youngSize(sizeof(String));
+            case Value::VT_Array:
+                return youngSize(sizeof(Array));
+            case Value::VT_Object:
+                return youngSize(sizeof(Object));
+            case Value::VT_Function:
+                return youngSize(sizeof(Function));
+            case Value::VT_Box:
+                return youngSize(sizeof(Box));
+            case Value::VT_Iterator:
+                return youngSize(sizeof(Iterator));
+            case Value::VT_Error:
+                return youngSize(sizeof(Error));
+            default:
+                return 0;
+        }
+    }
+
+    // The type of the objects of each kind, which picks their pool
+    template<class T> static constexpr Value::Type managedType();
+    template<> constexpr Value::Type managedType<String>() { return Value::VT_String; }
+    template<> constexpr Value::Type managedType<Function>() { return Value::VT_Function; }
+    template<> constexpr Value::Type managedType<Array>() { return Value::VT_Array; }
+    template<> constexpr Value::Type managedType<Object>() { return Value::VT_Object; }
+    template<> constexpr Value::Type managedType<Box>() { return Value::VT_Box; }
+    template<> constexpr Value::Type managedType<Iterator>() { return Value::VT_Iterator; }
+    template<> constexpr Value::Type managedType<Error>() { return Value::VT_Error; }
+
+    HeapPool::HeapPool(Value::Type type, size_t objectSize)
+    : type(type), slotSize(youngSize(objectSize)), slotsPerSlab(SlabSize / slotSize), freeList(nullptr), freeSlots(0)
+    {
+    }
+
+    HeapPool::~HeapPool()
+    {
+        clear();
+    }
+
+    void* HeapPool::allocate()
+    {
+        if(!freeList)
+        {
+            char* slab = new char[slotsPerSlab * slotSize];
+            slabs.push_back(slab);
+
+            // chained backwards, so the slots are handed out in address order
+            for(size_t index = slotsPerSlab; index-- > 0;)
+                release((GarbageCollected*)(slab + index * slotSize));
+        }
+
+        GarbageCollected* gc = freeList;
+        freeList = gc->next;
+        --freeSlots;
+
+        return gc;
+    }
+
+    void HeapPool::release(GarbageCollected* gc)
+    {
+        GarbageCollected* freeSlot = new(gc) GarbageCollected(type);
+        freeSlot->state = GarbageCollected::GC_Free;
+        freeSlot->next = freeList;
+
+        freeList = freeSlot;
+        ++freeSlots;
+    }
+
+    void HeapPool::clear()
+    {
+        for(char* slab : slabs)
+            delete[] slab;
+
+        slabs.clear();
+        freeList = nullptr;
+        freeSlots = 0;
+    }
+
+    MarkStack::MarkStack() : m_top(new Chunk()), m_spare(nullptr), m_count(0)
+    {
+        m_top->below = nullptr;
+    }
+
+    MarkStack::~MarkStack()
+    {
+        delete m_spare;
+
+        while(m_top)
+        {
+            Chunk* below = m_top->below;
+            delete m_top;
+            m_top = below;
+        }
+    }
+
+    void MarkStack::clear()
+    {
+        while(m_top->below)
+            removeChunk();
+
+        m_count = 0;
+    }
+
+    void MarkStack::addChunk()
+    {
+        Chunk* chunk = m_spare ? m_spare : new Chunk();
+        m_spare = nullptr;
+
+        chunk->below = m_top;
+        m_top = chunk;
+        m_count = 0;
+    }
+
+    void MarkStack::removeChunk()
+    {
+        delete m_spare;
+        m_spare = m_top;
+
+        m_top = m_top->below;
+        m_count = ChunkSize;
+    }
+
+    // Grays the managed values of an array or an object, or finds that it has none. Such
+    // a leaf is not looked into again until the write barrier sees a managed value stored.
+    template<class MakeGray>
+    static void markValues(GarbageCollected* gc, std::vector<Value>& values, MakeGray makeGray)
+    {
+        if(gc->flags & GarbageCollected::GCF_Leaf)
+            return;
+
+        bool leaf = true;
+
+        for(Value& value : values)
+        {
+            if(value.isManaged())
+            {
+                makeGray(value.garbageCollected());
+                leaf = false;
+            }
+        }
+
+        if(leaf)
+            gc->flags |= GarbageCollected::GCF_Leaf;
+    }
+
+    // The gray object scanned next was touched when it turned gray, but not its values,
+    // they are fetched while the current one is scanned
+    static void prefetchValues(const GarbageCollected* gc)
+    {
+        if(gc->flags & GarbageCollected::GCF_Leaf)
+            return;
+
+        if(gc->type == Value::VT_Array)
+            __builtin_prefetch(((const Array*)gc)->elements.data());
+        else if(gc->type == Value::VT_Object)
+            __builtin_prefetch(((const Object*)gc)->slots.data());
+    }
+
+    template<class T, class... Args>
+    T* MemoryManager::allocate(Args&&... args)
+    {
+        ++m_allocationscnt;
+
+        // the major cycles expect no young objects, they start with a minor collection
+        if(m_gcstage == GCS_Ready)
+        {
+            size_t size = youngSize(sizeof(T));
+
+            if(size_t(m_nurseryend - m_nurserytop) >= size)
+            {
+                T* gc = new(m_nurserytop) T(std::forward<Args>(args)...);
+                gc->flags = GarbageCollected::GCF_Young;
+                m_nurserytop += size;
+                return gc;
+            }
+
+            m_minordue = true;// full, old objects are made until the next safepoint
+        }
+
+        return allocateOld<T>(std::forward<Args>(args)...);
+    }
+
+    template<class T, class... Args>
+    T* MemoryManager::allocateOld(Args&&... args)
+    {
+        return new(m_pools[managedType<T>() - Value::VT_String].allocate()) T(std::forward<Args>(args)...);
+    }
+
+    MemoryManager::MemoryManager(int markThreads)
+    : m_pools{{Value::VT_String, sizeof(String)}, {Value::VT_Function, sizeof(Function)}, {Value::VT_Array, sizeof(Array)},
+              {Value::VT_Object, sizeof(Object)}, {Value::VT_Box, sizeof(Box)}, {Value::VT_Iterator, sizeof(Iterator)},
+              {Value::VT_Error, sizeof(Error)}},
+      m_gcstage(GCS_Ready), m_currentwhite(GarbageCollected::GC_White0), m_nextwhite(GarbageCollected::GC_White1),
+      m_sweepdone(false), m_gccycle(0), m_rootglobal(0), m_rootvalue(0), m_rootcontext(0), m_runningcontext(nullptr),
+      m_nursery(new char[NurserySize]), m_nurserytop(m_nursery), m_nurseryend(m_nursery + NurserySize),
+      m_nurserybytes(0), m_minordue(false), m_gcdebt(-int64_t(MinGCAllowance)), m_livebytes(0), m_markedbytes(0), m_gcgrowth(DefaultGCGrowth),
+      m_gcstepsize(DefaultGCStepSize), m_markthreads(std::max(markThreads, 1)), m_allocationscnt(0), m_heapstringscnt(0), m_heaparrayscnt(0), m_heapobjectscnt(0),
+      m_heapfunctionscnt(0), m_heapboxescnt(0), m_heapitercnt(0), m_heaperrorscnt(0)
+    {
+        // more threads than cores would only take turns
+        const unsigned cores = std::thread::hardware_concurrency();// 0 when it is not known
+
+        if(cores > 0)
+            m_markthreads = std::min(m_markthreads, int(cores));
     }
 
     MemoryManager::~MemoryManager()
     {
         deleteHeap();
+
+        for(ExecutionContext* context : m_freecontexts)
+            delete context;
+
+        delete[] m_nursery;
     }
 
     void MemoryManager::resetState()
@@ -29,9 +285,16 @@ namespace element
         m_gcstage = GCS_Ready;
         m_currentwhite = GarbageCollected::GC_White0;
         m_nextwhite = GarbageCollected::GC_White1;
-        m_prevgc = nullptr;
-        m_currgc = nullptr;
+        m_grayagain.clear();
+        m_rootglobals.clear();
+        m_rootcontexts.clear();
+        m_minordue = false;
 
+        m_gcdebt = -int64_t(MinGCAllowance);
+        m_livebytes = 0;
+        m_markedbytes = 0;
+
+        m_allocationscnt = 0;
         m_heapstringscnt = 0;
         m_heaparrayscnt = 0;
         m_heapobjectscnt = 0;
@@ -58,7 +321,7 @@ namespace element
 
     String* MemoryManager::makeString()
     {
-        String* newString = new String();
+        String* newString = allocate<String>();
 
         addToHeap(newString);
 
@@ -69,7 +332,7 @@ namespace element
 
     String* MemoryManager::makeString(const std::string& str)
     {
-        String* newString = new String(str);
+        String* newString = allocate<String>(str);
 
         addToHeap(newString);
 
@@ -80,7 +343,7 @@ namespace element
 
     String* MemoryManager::makeString(const char* str, int size)
     {
-        String* newString = new String(str, size);
+        String* newString = allocate<String>(str, size);
 
         addToHeap(newString);
 
@@ -91,7 +354,7 @@ namespace element
 
     Array* MemoryManager::makeArray()
     {
-        Array* newArray = new Array();
+        Array* newArray = allocate<Array>();
 
         addToHeap(newArray);
 
@@ -102,7 +365,7 @@ namespace element
 
     Object* MemoryManager::makeObject()
     {
-        Object* newObject = new Object();
+        Object* newObject = allocate<Object>(&m_rootshape);
 
         addToHeap(newObject);
 
@@ -113,8 +376,12 @@ namespace element
 
     Object* MemoryManager::makeObject(const Object* other)
     {
-        Object* newObject = new Object();
-        *newObject = *other;
+        Object* newObject = allocate<Object>(&m_rootshape);
+
+        newObject->slots[0] = other->slots[0];
+
+        for(unsigned i = 1; i < other->membersCount(); ++i)
+            newObject->addMember(other->memberHash(i), other->slots[i]);
 
         addToHeap(newObject);
 
@@ -125,7 +392,7 @@ namespace element
 
     Function* MemoryManager::makeFunction(const Function* other)
     {
-        Function* newFunction = new Function(other);
+        Function* newFunction = allocate<Function>(other);
 
         addToHeap(newFunction);
 
@@ -145,7 +412,7 @@ namespace element
 
     Box* MemoryManager::makeBox()
     {
-        Box* newBox = new Box();
+        Box* newBox = allocate<Box>();
 
         addToHeap(newBox);
 
@@ -156,7 +423,7 @@ namespace element
 
     Box* MemoryManager::makeBox(const Value& value)
     {
-        Box* newBox = new Box();
+        Box* newBox = allocate<Box>();
 
         newBox->value = value;
 
@@ -167,9 +434,9 @@ namespace element
         return newBox;
     }
 
-    Iterator* MemoryManager::makeIterator(IteratorImplementation* newIterator)
+    Iterator* MemoryManager::makeIterator()
     {
-        Iterator* iterator = new Iterator(newIterator);
+        Iterator* iterator = allocate<Iterator>();
 
         addToHeap(iterator);
 
@@ -180,7 +447,7 @@ namespace element
 
     Error* MemoryManager::makeError(const std::string& errorMessage)
     {
-        Error* newError = new Error(errorMessage);
+        Error* newError = allocate<Error>(errorMessage);
 
         addToHeap(newError);
 
@@ -191,7 +458,17 @@ namespace element
 
     ExecutionContext* MemoryManager::makeRootExecutionContext()
     {
-        ExecutionContext* newContext = new ExecutionContext();
+        ExecutionContext* newContext = nullptr;
+
+        if(m_freecontexts.empty())
+        {
+            newContext = new ExecutionContext();
+        }
+        else
+        {
+            newContext = m_freecontexts.back();
+            m_freecontexts.pop_back();
+        }
 
         m_excontexts.push_back(newContext);
 
@@ -200,12 +477,24 @@ namespace element
 
     bool MemoryManager::deleteRootExecutionContext(ExecutionContext* context)
     {
-        auto it = std::find(m_excontexts.begin(), m_excontexts.end(), context);
+        // root contexts are nested calls from native code, so the last one made goes first
+        auto it = !m_excontexts.empty() && m_excontexts.back() == context ? m_excontexts.end() - 1 :
+                  std::find(m_excontexts.begin(), m_excontexts.end(), context);
 
         if(it != m_excontexts.end())
         {
             m_excontexts.erase(it);
-            delete context;
+
+            // keep it for the next call, the stack keeps its memory
+            context->state = ExecutionContext::CRS_NotStarted;
+            context->parent = nullptr;
+            context->caller = nullptr;
+            context->lastObject = Value();
+            context->stackFrames.clear();
+            context->stack.resize(0);
+            context->scannedFrames = 0;
+
+            m_freecontexts.push_back(context);
             return true;
         }
 
@@ -214,11 +503,21 @@ namespace element
 
     void MemoryManager::collectGarbage(int steps)
     {
+        // a full collection does not return before the end, so the marking can be shared by threads
+        const bool full = steps == std::numeric_limits<int>::max();
+        const bool parallel = m_markthreads > 1 && full;
+
         switch(m_gcstage)
         {
             case GCS_Ready:
+                finishSweep();// the survivors of the last cycle are all of the next white again
+                collectYoung();// the marking only sees old objects
                 m_graylist.clear();
+                m_grayagain.clear();
                 std::swap(m_currentwhite, m_nextwhite);// White0 <-> White1
+                ++m_gccycle;// the stack barriers of the last cycle are void
+                m_markedbytes = 0;
+                takeRoots();
                 m_gcstage = GCS_MarkRoots;
 
             case GCS_MarkRoots:
@@ -228,194 +527,603 @@ namespace element
                 m_gcstage = GCS_Mark;
 
             case GCS_Mark:
+                if(parallel)
+                    parallelMark();
                 steps = mark(steps);
                 if(steps <= 0)
                     return;
-                m_gcstage = GCS_SweepHead;
-
-            case GCS_SweepHead:
-                steps = sweepHead(steps);
-                if(steps <= 0)
-                    return;
-                m_gcstage = GCS_SweepRest;
+                m_gcstage = GCS_Remark;
 
-            case GCS_SweepRest:
-                steps = sweepRest(steps);
-                if(steps <= 0)
-                    return;
+            case GCS_Remark:
+                remark();
+                startSweep();
                 m_gcstage = GCS_Ready;
+
+                // the heap may grow by the allowance before the next cycle starts
+                m_livebytes = m_markedbytes;
+                m_gcdebt = -int64_t(std::max(m_livebytes * std::max(m_gcgrowth - 100, 0) / 100, MinGCAllowance));
+
+                // nothing is left to be freed once a full collection returns
+                if(full)
+                    finishSweep();
         }
     }
 
+    void MemoryManager::stepGarbageCollection()
+    {
+        // the free slots of a finished sweep are taken back before they are needed
+        if(m_sweepdone.load(std::memory_order_acquire))
+            finishSweep();
+
+        if(m_minordue)
+            collectYoung();
+
+        if(m_gcdebt <= 0)// the promoted objects fit in the allowance
+            return;
+
+        collectGarbage(m_gcstepsize);
+
+        // a finished cycle has set a new allowance, otherwise the step pays for some allocation
+        if(m_gcstage != GCS_Ready)
+            m_gcdebt -= int64_t(m_gcstepsize) * int64_t(GCStepBytes);
+    }
+
+    void MemoryManager::setGCGrowth(int percent)
+    {
+        m_gcgrowth = std::max(percent, 100);
+    }
+
+    void MemoryManager::setGCStepSize(int steps)
+    {
+        m_gcstepsize = std::max(steps, 1);
+    }
+
+    int MemoryManager::getGCGrowth() const
+    {
+        return m_gcgrowth;
+    }
+
+    int MemoryManager::getGCStepSize() const
+    {
+        return m_gcstepsize;
+    }
+
+    int MemoryManager::getMarkThreads() const
+    {
+        return m_markthreads;
+    }
+
+    size_t MemoryManager::liveHeapBytes() const
+    {
+        return m_livebytes;
+    }
+
+    size_t MemoryManager::slabBytes() const
+    {
+        size_t bytes = 0;
+
+        for(const HeapPool& pool : m_pools)
+            bytes += pool.slotsCount() * pool.slotSize;
+
+        return bytes;
+    }
+
+    size_t MemoryManager::usedSlotsCount() const
+    {
+        size_t count = 0;
+
+        for(const HeapPool& pool : m_pools)
+            count += pool.slotsCount() - pool.freeSlots;
+
+        return count;
+    }
+
+    size_t MemoryManager::freeSlotsCount() const
+    {
+        size_t count = 0;
+
+        for(const HeapPool& pool : m_pools)
+            count += pool.freeSlots;
+
+        return count;
+    }
+
+    uint64_t MemoryManager::allocationsCount() const
+    {
+        return m_allocationscnt;
+    }
+
+    void MemoryManager::setRunningContext(ExecutionContext* const* context)
+    {
+        m_runningcontext = context;
+    }
+
+    void MemoryManager::pushTemporaryRoot(Value* value)
+    {
+        m_temproots.push_back(value);
+    }
+
+    void MemoryManager::popTemporaryRoots(unsigned count)
+    {
+        m_temproots.resize(m_temproots.size() - count);
+    }
+
     void MemoryManager::updateGCRelationship(GarbageCollected* parent, const Value& child)
     {
+        if(!child.isManaged())
+            return;
+
+        GarbageCollected* gc = child.garbageCollected();
+
+        // the marking looks into the parent again
+        parent->flags &= ~GarbageCollected::GCF_Leaf;
+
         // the tri-color invariant states that at no point shall
         // a black node be directly connected to a white node
-        if(parent->state == GarbageCollected::GC_Black && child.isManaged() && child.garbageCollected->state == m_currentwhite)
+        // (only while marking, the sweeper thread may be writing the colors otherwise)
+        if((m_gcstage == GCS_MarkRoots || m_gcstage == GCS_Mark) &&
+           parent->state == GarbageCollected::GC_Black && gc->state == m_currentwhite)
         {
-            child.garbageCollected->state = GarbageCollected::State::GC_Gray;
-            m_graylist.push_back(child.garbageCollected);
+            gc->state = GarbageCollected::State::GC_Gray;
+            m_graylist.push(gc);
         }
-    }
 
-    int MemoryManager::heapObjectsCount(Value::Type type) const
-    {
-        switch(type)
+        // the minor collections find the young objects that old ones point to in the remembered set
+        if((gc->flags & GarbageCollected::GCF_Young) && !(parent->flags & (GarbageCollected::GCF_Young | GarbageCollected::GCF_Remembered)))
         {
-            case Value::VT_String:
-                return m_heapstringscnt;
-            case Value::VT_Array:
-                return m_heaparrayscnt;
-            case Value::VT_Object:
-                return m_heapobjectscnt;
-            case Value::VT_Function:
-                return m_heapfunctionscnt;
-            case Value::VT_Box:
-                return m_heapboxescnt;
-            case Value::VT_Iterator:
-                return m_heapitercnt;
-            case Value::VT_Error:
-                return m_heaperrorscnt;
-            default:
-                return 0;
+            parent->flags |= GarbageCollected::GCF_Remembered;
+            m_remembered.push_back(parent);
         }
     }
 
-    void MemoryManager::deleteHeap()
+    void MemoryManager::rememberObject(GarbageCollected* gc)
     {
-        while(m_heaphead)
+        // the nursery is empty during the major cycles, which may free the remembered objects
+        if(m_nurserytop != m_nursery && !(gc->flags & (GarbageCollected::GCF_Young | GarbageCollected::GCF_Remembered)))
         {
-            GarbageCollected* next = m_heaphead->next;
-            ;
-            freeGC(m_heaphead);
-            m_heaphead = next;
+            gc->flags |= GarbageCollected::GCF_Remembered;
+            m_remembered.push_back(gc);
         }
     }
 
-    void MemoryManager::addToHeap(GarbageCollected* gc)
+    GarbageCollected* MemoryManager::moveObject(GarbageCollected* gc)
     {
-        gc->state = m_nextwhite;
-
-        if(m_heaphead)
-            gc->next = m_heaphead;
+        // the copy in the old space takes over the contents, the original is left empty
+        GarbageCollected* moved = nullptr;
 
-        m_heaphead = gc;
-    }
-
-    void MemoryManager::freeGC(GarbageCollected* gc)
-    {
         switch(gc->type)
         {
             case Value::VT_String:
-                delete(String*)gc;
-                --m_heapstringscnt;
+            {
+                String* string = allocateOld<String>();
+                string->str.swap(((String*)gc)->str);
+                moved = string;
                 break;
+            }
 
             case Value::VT_Array:
-                delete(Array*)gc;
-                --m_heaparrayscnt;
+            {
+                Array* array = allocateOld<Array>();
+                array->elements.swap(((Array*)gc)->elements);
+                moved = array;
                 break;
+            }
 
             case Value::VT_Object:
-                delete(Object*)gc;
-                --m_heapobjectscnt;
+            {
+                Object* original = (Object*)gc;
+                Object* object = allocateOld<Object>(original->shape);
+                object->slots.swap(original->slots);
+                original->shape = &m_rootshape;// a dictionary shape belongs to the copy now
+                moved = object;
                 break;
+            }
 
             case Value::VT_Function:
             {
-                Function* f = (Function*)gc;
-                if(f->executionContext)
-                    delete f->executionContext;
-                delete f;
-                --m_heapfunctionscnt;
+                Function* original = (Function*)gc;
+                Function* function = allocateOld<Function>(original->codeObject);
+                function->freeVariables.swap(original->freeVariables);
+                function->executionContext = original->executionContext;
+                original->executionContext = nullptr;
+                moved = function;
                 break;
             }
+
             case Value::VT_Box:
-                delete(Box*)gc;
-                --m_heapboxescnt;
+            {
+                Box* box = allocateOld<Box>();
+                box->value = ((Box*)gc)->value;
+                moved = box;
                 break;
+            }
 
             case Value::VT_Iterator:
-                delete(Iterator*)gc;// virtual call
-                --m_heapitercnt;
+            {
+                Iterator* original = (Iterator*)gc;
+                Iterator* iterator = allocateOld<Iterator>();
+                iterator->implementation = original->implementation->moveTo(iterator->storage);// virtual call
+                moved = iterator;
                 break;
+            }
 
             case Value::VT_Error:
-                delete(Error*)gc;
-                --m_heaperrorscnt;
+            {
+                Error* error = allocateOld<Error>();
+                error->errorString.swap(((Error*)gc)->errorString);
+                moved = error;
                 break;
+            }
 
             default:
-                break;
+                return gc;
         }
-    }
 
-    void MemoryManager::makeGrayIfNeeded(GarbageCollected* gc, int* steps)
-    {
-        if(gc->state == m_currentwhite)
-        {
-            gc->state = GarbageCollected::GC_Gray;
-            m_graylist.push_back(gc);
+        gc->flags |= GarbageCollected::GCF_Forwarded;
+        gc->next = moved;
 
-            *steps -= 1;
-        }
+        return moved;
     }
 
-    int MemoryManager::markRoots(int steps)
+    GarbageCollected* MemoryManager::promoteYoung(GarbageCollected* gc)
     {
-        for(Value& global : m_defmodule.globals)
-            if(global.isManaged())
-                makeGrayIfNeeded(global.garbageCollected, &steps);
+        // moved already, by this minor collection or by a compaction
+        if(gc->flags & GarbageCollected::GCF_Forwarded)
+            return gc->next;
 
-        for(auto& kvp : m_modules)
-            for(Value& global : kvp.second.globals)
-                if(global.isManaged())
-                    makeGrayIfNeeded(global.garbageCollected, &steps);
+        if(!(gc->flags & GarbageCollected::GCF_Young))
+            return gc;
 
-        for(ExecutionContext* context : m_excontexts)
-        {
-            for(StackFrame& frame : context->stackFrames)
-            {
-                for(Value& local : frame.variables)
-                    if(local.isManaged())
-                        makeGrayIfNeeded(local.garbageCollected, &steps);
+        GarbageCollected* promoted = moveObject(gc);
 
-                for(Value& anonymousParameter : frame.anonymousParameters.elements)
-                    if(anonymousParameter.isManaged())
-                        makeGrayIfNeeded(anonymousParameter.garbageCollected, &steps);
-            }
+        if(promoted == gc)// not a managed type
+            return gc;
 
-            for(Value& value : context->stack)
-                if(value.isManaged())
-                    makeGrayIfNeeded(value.garbageCollected, &steps);
-        }
+        // it joins the old space, which pays for it with the allowance of the major cycles
+        promoted->state = m_nextwhite;
+        m_gcdebt += int64_t(heapSize(promoted));
 
-        return steps;
+        if(gc->type != Value::VT_String && gc->type != Value::VT_Error)
+            m_promoted.push_back(promoted);
+
+        return promoted;
     }
 
-    int MemoryManager::mark(int steps)
+    void MemoryManager::promoteYoung(Value& value)
     {
-        GarbageCollected* currentObject = nullptr;
+        if(value.type() >= Value::VT_String && (value.garbageCollected()->flags & (GarbageCollected::GCF_Young | GarbageCollected::GCF_Forwarded)))
+            value.relocate(promoteYoung(value.garbageCollected()));
+    }
 
-        while(!m_graylist.empty() && steps > 0)
-        {
-            currentObject = m_graylist.back();
-            currentObject->state = GarbageCollected::GC_Black;
-            m_graylist.pop_back();
-            steps -= 1;
+    int MemoryManager::heapObjectsCount(Value::Type type) const
+    {
+        int count = 0;
+
+        switch(type)
+        {
+            case Value::VT_String:
+                count = m_heapstringscnt;
+                break;
+            case Value::VT_Array:
+                count = m_heaparrayscnt;
+                break;
+            case Value::VT_Object:
+                count = m_heapobjectscnt;
+                break;
+            case Value::VT_Function:
+                count = m_heapfunctionscnt;
+                break;
+            case Value::VT_Box:
+                count = m_heapboxescnt;
+                break;
+            case Value::VT_Iterator:
+                count = m_heapitercnt;
+                break;
+            case Value::VT_Error:
+                count = m_heaperrorscnt;
+                break;
+            default:
+                return 0;
+        }
+
+        // what a running sweep has freed is not taken off the counters yet
+        return count - m_swept[type - Value::VT_String].freedObjects.load(std::memory_order_relaxed);
+    }
+
+    void MemoryManager::deleteHeap()
+    {
+        finishSweep();
+
+        for(char* young = m_nursery; young != m_nurserytop; young += youngSize((GarbageCollected*)young))
+            freeGC((GarbageCollected*)young);
+
+        m_nurserytop = m_nursery;
+        m_nurserybytes = 0;
+
+        for(GarbageCollected* gc : m_remembered)
+            gc->flags &= ~GarbageCollected::GCF_Remembered;
+
+        m_remembered.clear();
+
+        for(HeapPool& pool : m_pools)
+        {
+            for(size_t slab = 0; slab < pool.slabs.size(); ++slab)
+                for(size_t index = 0; index < pool.slotsPerSlab; ++index)
+                    if(pool.slot(slab, index)->state != GarbageCollected::GC_Free)
+                        freeGC(pool.slot(slab, index));
+
+            pool.clear();
+        }
+    }
+
+    void MemoryManager::addToHeap(GarbageCollected* gc)
+    {
+        if(gc->flags & GarbageCollected::GCF_Young)
+        {
+            gc->state = m_nextwhite;
+            m_nurserybytes += heapSize(gc);
+
+            // the strings and vectors of the young objects count too
+            if(m_nurserybytes >= NurserySize)
+                m_minordue = true;
+
+            return;
+        }
+
+        // while marking, new objects are white so the remark finds them if they
+        // are still used, otherwise they are already of the next cycle
+        if(m_gcstage == GCS_MarkRoots || m_gcstage == GCS_Mark)
+            gc->state = m_currentwhite;
+        else
+            gc->state = m_nextwhite;
+
+        m_gcdebt += int64_t(heapSize(gc));
+
+        // made old because the nursery is full, it may be given young objects without barriers
+        rememberObject(gc);
+    }
+
+    // Runs the destructor of an object, on the sweeper thread too, so it touches nothing else
+    static void destroyGC(GarbageCollected* gc)
+    {
+        switch(gc->type)
+        {
+            case Value::VT_String:
+                ((String*)gc)->~String();
+                break;
+
+            case Value::VT_Array:
+                ((Array*)gc)->~Array();
+                break;
+
+            case Value::VT_Object:
+                ((Object*)gc)->~Object();
+                break;
+
+            case Value::VT_Function:
+            {
+                Function* f = (Function*)gc;
+                if(f->executionContext)
+                    delete f->executionContext;
+                f->~Function();
+                break;
+            }
+            case Value::VT_Box:
+                ((Box*)gc)->~Box();
+                break;
+
+            case Value::VT_Iterator:
+                ((Iterator*)gc)->~Iterator();// virtual call
+                break;
+
+            case Value::VT_Error:
+                ((Error*)gc)->~Error();
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    void MemoryManager::freeGC(GarbageCollected* gc)
+    {
+        Value::Type type = gc->type;
+        bool young = gc->flags & GarbageCollected::GCF_Young;
+
+        // a promoted young object lives on in its old copy, which is counted already
+        int freed = (gc->flags & GarbageCollected::GCF_Forwarded) ? 0 : 1;
+
+        switch(type)
+        {
+            case Value::VT_String:
+                m_heapstringscnt -= freed;
+                break;
+            case Value::VT_Array:
+                m_heaparrayscnt -= freed;
+                break;
+            case Value::VT_Object:
+                m_heapobjectscnt -= freed;
+                break;
+            case Value::VT_Function:
+                m_heapfunctionscnt -= freed;
+                break;
+            case Value::VT_Box:
+                m_heapboxescnt -= freed;
+                break;
+            case Value::VT_Iterator:
+                m_heapitercnt -= freed;
+                break;
+            case Value::VT_Error:
+                m_heaperrorscnt -= freed;
+                break;
+            default:
+                return;
+        }
+
+        destroyGC(gc);
+
+        // the memory of the young objects is part of the nursery
+        if(!young)
+            m_pools[type - Value::VT_String].release(gc);
+    }
+
+    void MemoryManager::makeGrayIfNeeded(GarbageCollected* gc, int* steps)
+    {
+        if(gc->state == m_currentwhite)
+        {
+            gc->state = GarbageCollected::GC_Gray;
+            m_graylist.push(gc);
+
+            *steps -= 1;
+        }
+    }
+
+    bool MemoryManager::markExecutionContext(ExecutionContext* context, int* steps)
+    {
+        // The frames are scanned from the stack barrier up, and the barrier follows the
+        // scan. The script moves it back down when it returns to a frame below it, so
+        // the scan resumes there and a rescan skips the frames that did not run since.
+        if(context->scanCycle != m_gccycle)
+        {
+            context->scanCycle = m_gccycle;
+            context->scannedFrames = 0;
+        }
+
+        if(context->lastObject.isManaged())
+            makeGrayIfNeeded(context->lastObject.garbageCollected(), steps);
+
+        const unsigned framesCount = unsigned(context->stackFrames.size());
+        Value* bottom = context->stack.bottom();
+
+        for(unsigned i = context->scannedFrames; i < framesCount; ++i)
+        {
+            if(*steps <= 0)
+                return false;
+
+            StackFrame& frame = context->stackFrames[i];
+
+            // a closure or a coroutine may be referenced by nothing but its running frame
+            makeGrayIfNeeded(frame.function, steps);
+
+            if(frame.anonymousParameters)
+                makeGrayIfNeeded(frame.anonymousParameters, steps);
+
+            if(frame.thisObject.isManaged())
+                makeGrayIfNeeded(frame.thisObject.garbageCollected(), steps);
+
+            // the locals and operands of the frame, up to the next one
+            Value* end = i + 1 < framesCount ? bottom + context->stackFrames[i + 1].base : context->stack.top;
+
+            for(Value* value = i == 0 ? bottom : bottom + frame.base; value < end; ++value)
+                if(value->isManaged())
+                    makeGrayIfNeeded(value->garbageCollected(), steps);
+
+            *steps -= int(end - bottom - (i == 0 ? 0 : frame.base)) + 1;
+
+            // the running frame changes without barriers, it is always scanned again
+            if(i + 1 < framesCount)
+                context->scannedFrames = i + 1;
+        }
+
+        // without frames, the values are whatever was left on the stack
+        if(framesCount == 0)
+            for(Value* value = bottom; value != context->stack.top; ++value)
+                if(value->isManaged())
+                    makeGrayIfNeeded(value->garbageCollected(), steps);
+
+        return true;
+    }
+
+    void MemoryManager::takeRoots()
+    {
+        // the globals and the stacks as they are when the cycle starts, markRoots goes
+        // through them over several steps, the remark looks at the ones made since
+        m_rootglobals.clear();
+        m_rootcontexts.clear();
+        m_rootglobal = 0;
+        m_rootvalue = 0;
+        m_rootcontext = 0;
+
+        m_rootglobals.push_back(&m_defmodule.globals);
+
+        for(auto& kvp : m_modules)
+            m_rootglobals.push_back(&kvp.second.globals);
+
+        for(ExecutionContext* context : m_excontexts)
+        {
+            m_rootcontexts.push_back(context);
+
+            for(ExecutionContext* caller = context->caller; caller; caller = caller->parent)
+                m_rootcontexts.push_back(caller);
+        }
+
+        // a running coroutine and the ones that resumed it
+        if(m_runningcontext)
+            for(ExecutionContext* context = *m_runningcontext; context; context = context->parent)
+                m_rootcontexts.push_back(context);
+    }
+
+    int MemoryManager::markRoots(int steps)
+    {
+        // every value looked at is a unit of work, so a large root set is spread over steps
+        for(; m_rootglobal < m_rootglobals.size(); ++m_rootglobal, m_rootvalue = 0)
+        {
+            std::vector<Value>& globals = *m_rootglobals[m_rootglobal];
+
+            for(; m_rootvalue < globals.size(); ++m_rootvalue)
+            {
+                if(steps <= 0)
+                    return steps;
+
+                if(globals[m_rootvalue].isManaged())
+                    makeGrayIfNeeded(globals[m_rootvalue].garbageCollected(), &steps);
+
+                steps -= 1;
+            }
+        }
+
+        // the results of the modules, a module loaded again gives its result again
+        if(m_defmodule.result.isManaged())
+            makeGrayIfNeeded(m_defmodule.result.garbageCollected(), &steps);
+
+        for(auto& kvp : m_modules)
+            if(kvp.second.result.isManaged())
+                makeGrayIfNeeded(kvp.second.result.garbageCollected(), &steps);
+
+        for(; m_rootcontext < m_rootcontexts.size(); ++m_rootcontext)
+            if(!markExecutionContext(m_rootcontexts[m_rootcontext], &steps))
+                return steps;
+
+        for(const Value* value : m_temproots)
+            if(value->isManaged())
+                makeGrayIfNeeded(value->garbageCollected(), &steps);
+
+        return steps;
+    }
+
+    int MemoryManager::mark(int steps)
+    {
+        GarbageCollected* currentObject = nullptr;
+
+        while(!m_graylist.empty() && steps > 0)
+        {
+            currentObject = m_graylist.pop();
+            currentObject->state = GarbageCollected::GC_Black;
+            steps -= 1;
+
+            if(!m_graylist.empty())
+                prefetchValues(m_graylist.back());
+
+            auto makeGray = [&](GarbageCollected* gc) { makeGrayIfNeeded(gc, &steps); };
 
             switch(currentObject->type)
             {
                 case Value::VT_Array:
-                    for(Value& element : ((Array*)currentObject)->elements)
-                        if(element.isManaged())
-                            makeGrayIfNeeded(element.garbageCollected, &steps);
+                    markValues(currentObject, ((Array*)currentObject)->elements, makeGray);
                     break;
 
                 case Value::VT_Object:
-                    for(Object::Member& member : ((Object*)currentObject)->members)
-                        if(member.value.isManaged())
-                            makeGrayIfNeeded(member.value.garbageCollected, &steps);
+                    markValues(currentObject, ((Object*)currentObject)->slots, makeGray);
                     break;
 
                 case Value::VT_Function:
@@ -427,20 +1135,16 @@ namespace element
 
                     if(function->executionContext)
                     {
-                        for(StackFrame& frame : function->executionContext->stackFrames)
+                        // a deep stack takes several steps, the coroutine stays gray until it is done
+                        if(!markExecutionContext(function->executionContext, &steps))
                         {
-                            for(Value& local : frame.variables)
-                                if(local.isManaged())
-                                    makeGrayIfNeeded(local.garbageCollected, &steps);
-
-                            for(Value& anonymousParameter : frame.anonymousParameters.elements)
-                                if(anonymousParameter.isManaged())
-                                    makeGrayIfNeeded(anonymousParameter.garbageCollected, &steps);
+                            function->state = GarbageCollected::GC_Gray;
+                            m_graylist.push(function);
+                            continue;
                         }
 
-                        for(Value& value : function->executionContext->stack)
-                            if(value.isManaged())
-                                makeGrayIfNeeded(value.garbageCollected, &steps);
+                        // its stack changes without barriers when it runs
+                        m_grayagain.push_back(function);
                     }
                     break;
                 }
@@ -449,7 +1153,7 @@ namespace element
                 {
                     Value& value = ((Box*)currentObject)->value;
                     if(value.isManaged())
-                        makeGrayIfNeeded(value.garbageCollected, &steps);
+                        makeGrayIfNeeded(value.garbageCollected(), &steps);
                     break;
                 }
 
@@ -460,56 +1164,551 @@ namespace element
                 default:
                     break;
             }
+
+            m_markedbytes += heapSize(currentObject);// what survives, the sweep does not measure it
         }
 
         return steps;
     }
 
-    int MemoryManager::sweepHead(int steps)
+    void MemoryManager::remark()
+    {
+        // The stacks and globals are written without barriers, so the roots are marked
+        // again at once, along with everything new that they reach, before the sweep.
+        // The stack barriers keep this to the frames that ran since they were scanned.
+        int steps = std::numeric_limits<int>::max();
+
+        takeRoots();
+        markRoots(steps);
+
+        for(size_t i = 0; i < m_grayagain.size(); ++i)// the vector grows while marking
+        {
+            markExecutionContext(m_grayagain[i]->executionContext, &steps);
+            mark(steps);
+        }
+
+        mark(steps);
+    }
+
+    // The gray objects that a marker thread offers to the others
+    struct SharedGrayStack
+    {
+        std::mutex lock;
+        std::vector<GarbageCollected*> objects;
+    };
+
+    void MemoryManager::parallelMark()
     {
-        while(m_heaphead && steps > 0)
+        // The script waits while the threads empty the gray list. Each has gray objects
+        // of its own and shares the surplus, the others steal it when they run out.
+        // Any thread may find an object, the one that turns it gray marks it.
+        const int threadsCount = m_markthreads;
+        const GarbageCollected::State currentWhite = m_currentwhite;
+
+        std::unique_ptr<SharedGrayStack[]> shared(new SharedGrayStack[threadsCount]);
+        std::atomic<int> idleThreads(0);
+        std::atomic<size_t> markedBytes(0);
+        std::mutex grayAgainLock;
+
+        for(int i = 0; !m_graylist.empty(); ++i)
+            shared[i % threadsCount].objects.push_back(m_graylist.pop());
+
+        auto markThread = [&](int index)
         {
-            if(m_heaphead->state == m_currentwhite)
+            std::vector<GarbageCollected*> gray;
+            MarkStack found;// what the iterators report
+            size_t bytes = 0;
+
+            auto makeGray = [&](GarbageCollected* gc)
             {
-                GarbageCollected* next = m_heaphead->next;
-                freeGC(m_heaphead);
-                m_heaphead = next;
+                GarbageCollected::State white = currentWhite;
+
+                if(std::atomic_ref<GarbageCollected::State>(gc->state).compare_exchange_strong(white, GarbageCollected::GC_Gray))
+                    gray.push_back(gc);
+            };
+
+            auto makeValueGray = [&](const Value& value)
+            {
+                if(value.isManaged())
+                    makeGray(value.garbageCollected());
+            };
+
+            auto markContext = [&](ExecutionContext* context)
+            {
+                makeValueGray(context->lastObject);
+
+                for(StackFrame& frame : context->stackFrames)
+                {
+                    makeGray(frame.function);
+
+                    if(frame.anonymousParameters)
+                        makeGray(frame.anonymousParameters);
+
+                    makeValueGray(frame.thisObject);
+                }
+
+                for(Value* value = context->stack.bottom(); value != context->stack.top; ++value)
+                    makeValueGray(*value);
+
+                // as markExecutionContext leaves it, only the running frame is scanned again
+                context->scanCycle = m_gccycle;
+                context->scannedFrames = context->stackFrames.empty() ? 0 : unsigned(context->stackFrames.size()) - 1;
+            };
+
+            // from the own shared stack first, otherwise from the others
+            auto takeWork = [&]() -> bool
+            {
+                idleThreads.fetch_add(1);
+
+                while(true)
+                {
+                    for(int i = 0; i < threadsCount; ++i)
+                    {
+                        SharedGrayStack& stack = shared[(index + i) % threadsCount];
+                        std::lock_guard<std::mutex> guard(stack.lock);
+
+                        if(!stack.objects.empty())
+                        {
+                            size_t half = (stack.objects.size() + 1) / 2;
+                            gray.assign(stack.objects.end() - half, stack.objects.end());
+                            stack.objects.resize(stack.objects.size() - half);
+                            idleThreads.fetch_sub(1);
+                            return true;
+                        }
+                    }
+
+                    // nothing is shared and nobody is left to share anything
+                    if(idleThreads.load() == threadsCount)
+                        return false;
+
+                    std::this_thread::yield();
+                }
+            };
+
+            while(!gray.empty() || takeWork())
+            {
+                GarbageCollected* currentObject = gray.back();
+                gray.pop_back();
+
+                std::atomic_ref<GarbageCollected::State>(currentObject->state).store(GarbageCollected::GC_Black, std::memory_order_relaxed);
+                bytes += heapSize(currentObject);
+
+                if(!gray.empty())
+                    prefetchValues(gray.back());
+
+                switch(currentObject->type)
+                {
+                    case Value::VT_Array:
+                        markValues(currentObject, ((Array*)currentObject)->elements, makeGray);
+                        break;
+
+                    case Value::VT_Object:
+                        markValues(currentObject, ((Object*)currentObject)->slots, makeGray);
+                        break;
+
+                    case Value::VT_Function:
+                    {
+                        Function* function = ((Function*)currentObject);
+                        for(Box* box : function->freeVariables)
+                            if(box)
+                                makeGray(box);
+
+                        if(function->executionContext)
+                        {
+                            markContext(function->executionContext);
+
+                            std::lock_guard<std::mutex> guard(grayAgainLock);
+                            m_grayagain.push_back(function);
+                        }
+                        break;
+                    }
+
+                    case Value::VT_Box:
+                        makeValueGray(((Box*)currentObject)->value);
+                        break;
+
+                    case Value::VT_Iterator:
+                        ((Iterator*)currentObject)->implementation->updateGrayList(found, currentWhite);// virtual call
+                        while(!found.empty())
+                            makeGray(found.pop());
+                        break;
+
+                    default:
+                        break;
+                }
+
+                // let the idle threads have some of it
+                if(gray.size() > MarkShareSize && idleThreads.load(std::memory_order_relaxed) > 0)
+                {
+                    SharedGrayStack& stack = shared[index];
+                    std::lock_guard<std::mutex> guard(stack.lock);
+
+                    size_t half = gray.size() / 2;
+                    stack.objects.insert(stack.objects.end(), gray.begin(), gray.begin() + half);
+                    gray.erase(gray.begin(), gray.begin() + half);
+                }
             }
-            else
+
+            markedBytes.fetch_add(bytes);
+        };
+
+        std::vector<std::thread> threads;
+
+        for(int i = 1; i < threadsCount; ++i)
+            threads.emplace_back(markThread, i);
+
+        markThread(0);
+
+        for(std::thread& thread : threads)
+            thread.join();
+
+        m_markedbytes += markedBytes.load();
+    }
+
+    void MemoryManager::collectYoung()
+    {
+        m_minordue = false;
+
+        if(m_nurserytop == m_nursery)
+            return;
+
+        // the used young objects are reachable from the roots, from the old objects
+        // of the remembered set or from the objects promoted because of them
+        promoteRoots();
+
+        for(GarbageCollected* gc : m_remembered)
+        {
+            gc->flags &= ~GarbageCollected::GCF_Remembered;
+            promoteReferences(gc);
+        }
+
+        m_remembered.clear();
+
+        while(!m_promoted.empty())
+        {
+            GarbageCollected* gc = m_promoted.back();
+            m_promoted.pop_back();
+            promoteReferences(gc);
+        }
+
+        // what is left behind is either garbage or the empty shell of a promoted object
+        for(char* young = m_nursery; young != m_nurserytop; young += youngSize((GarbageCollected*)young))
+            freeGC((GarbageCollected*)young);
+
+        m_nurserytop = m_nursery;
+        m_nurserybytes = 0;
+    }
+
+    void MemoryManager::promoteRoots()
+    {
+        for(Value& global : m_defmodule.globals)
+            promoteYoung(global);
+
+        promoteYoung(m_defmodule.result);
+
+        for(auto& kvp : m_modules)
+        {
+            for(Value& global : kvp.second.globals)
+                promoteYoung(global);
+
+            promoteYoung(kvp.second.result);
+        }
+
+        for(ExecutionContext* context : m_excontexts)
+        {
+            promoteExecutionContext(context);
+            promoteContextChain(context->caller);
+        }
+
+        if(m_runningcontext)
+            promoteContextChain(*m_runningcontext);
+
+        for(Value* value : m_temproots)
+            promoteYoung(*value);
+    }
+
+    void MemoryManager::promoteExecutionContext(ExecutionContext* context)
+    {
+        promoteYoung(context->lastObject);
+
+        for(StackFrame& frame : context->stackFrames)
+        {
+            frame.function = (Function*)promoteYoung(frame.function);
+
+            if(frame.anonymousParameters)
+                frame.anonymousParameters = (Array*)promoteYoung(frame.anonymousParameters);
+
+            promoteYoung(frame.thisObject);
+        }
+
+        for(Value* value = context->stack.bottom(); value != context->stack.top; ++value)
+            promoteYoung(*value);
+    }
+
+    void MemoryManager::promoteContextChain(ExecutionContext* context)
+    {
+        for(; context; context = context->parent)
+            promoteExecutionContext(context);
+    }
+
+    void MemoryManager::promoteReferences(GarbageCollected* gc)
+    {
+        switch(gc->type)
+        {
+            case Value::VT_Array:
+                for(Value& element : ((Array*)gc)->elements)
+                    promoteYoung(element);
+                break;
+
+            case Value::VT_Object:
+                for(Value& value : ((Object*)gc)->slots)
+                    promoteYoung(value);
+                break;
+
+            case Value::VT_Function:
             {
-                m_heaphead->state = m_nextwhite;
-                m_prevgc = m_heaphead;
-                m_currgc = m_heaphead->next;
+                Function* function = (Function*)gc;
+                for(Box*& box : function->freeVariables)
+                    if(box)
+                        box = (Box*)promoteYoung(box);
+
+                if(function->executionContext)
+                    promoteExecutionContext(function->executionContext);
                 break;
             }
 
-            steps -= 1;
+            case Value::VT_Box:
+                promoteYoung(((Box*)gc)->value);
+                break;
+
+            case Value::VT_Iterator:
+            {
+                IteratorImplementation* implementation = ((Iterator*)gc)->implementation;
+                promoteYoung(implementation->thisObjectUsed);
+                promoteYoung(implementation->hasNextFunction);
+                promoteYoung(implementation->getNextFunction);
+                implementation->promoteYoung(*this);// virtual call
+                break;
+            }
+
+            default:
+                break;
         }
+    }
 
-        return steps;
+    int MemoryManager::compactHeap()
+    {
+        // after a full collection the nursery is empty and the slabs hold only used objects
+        collectGarbage();
+
+        std::vector<char*> evacuated[PoolsCount];
+        int movedCount = 0;
+
+        for(int i = 0; i < PoolsCount; ++i)
+        {
+            HeapPool& pool = m_pools[i];
+
+            std::vector<std::pair<size_t, char*>> slabs;// the used slots of every slab
+            size_t usedSlots = 0;
+
+            for(size_t slab = 0; slab < pool.slabs.size(); ++slab)
+            {
+                size_t used = 0;
+
+                for(size_t index = 0; index < pool.slotsPerSlab; ++index)
+                    used += pool.slot(slab, index)->state != GarbageCollected::GC_Free;
+
+                slabs.emplace_back(used, pool.slabs[slab]);
+                usedSlots += used;
+            }
+
+            // the fullest slabs that can hold everything are kept, the others are emptied into them
+            std::stable_sort(slabs.begin(), slabs.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+            size_t keptCount = (usedSlots + pool.slotsPerSlab - 1) / pool.slotsPerSlab;
+
+            if(keptCount == slabs.size())
+                continue;
+
+            pool.slabs.clear();
+            pool.freeList = nullptr;
+            pool.freeSlots = 0;
+
+            for(size_t slab = 0; slab < slabs.size(); ++slab)
+                (slab < keptCount ? pool.slabs : evacuated[i]).push_back(slabs[slab].second);
+
+            // the free slots of the kept slabs, chained backwards so they are used in address order
+            for(size_t slab = pool.slabs.size(); slab-- > 0;)
+                for(size_t index = pool.slotsPerSlab; index-- > 0;)
+                    if(pool.slot(slab, index)->state == GarbageCollected::GC_Free)
+                        pool.release(pool.slot(slab, index));
+
+            for(char* slab : evacuated[i])
+            {
+                for(size_t index = 0; index < pool.slotsPerSlab; ++index)
+                {
+                    GarbageCollected* gc = (GarbageCollected*)(slab + index * pool.slotSize);
+
+                    if(gc->state == GarbageCollected::GC_Free)
+                        continue;
+
+                    moveObject(gc)->state = gc->state;
+                    ++movedCount;
+                }
+            }
+        }
+
+        if(movedCount == 0)
+            return 0;
+
+        // every reference to a moved object is made to point to its new place, the
+        // minor collections do the same for the promoted objects
+        promoteRoots();
+
+        for(HeapPool& pool : m_pools)
+            for(size_t slab = 0; slab < pool.slabs.size(); ++slab)
+                for(size_t index = 0; index < pool.slotsPerSlab; ++index)
+                    if(pool.slot(slab, index)->state != GarbageCollected::GC_Free)
+                        promoteReferences(pool.slot(slab, index));
+
+        m_grayagain.clear();
+
+        // what is left in the emptied slabs are the shells of the moved objects
+        for(int i = 0; i < PoolsCount; ++i)
+        {
+            for(char* slab : evacuated[i])
+            {
+                for(size_t index = 0; index < m_pools[i].slotsPerSlab; ++index)
+                {
+                    GarbageCollected* gc = (GarbageCollected*)(slab + index * m_pools[i].slotSize);
+
+                    if(gc->state != GarbageCollected::GC_Free)
+                        destroyGC(gc);
+                }
+
+                delete[] slab;
+            }
+        }
+
+        return movedCount;
     }
 
-    int MemoryManager::sweepRest(int steps)
+    // Frees the white objects of the slabs handed to the sweeper thread. The free slots
+    // of each slab are chained in address order, and a slab left empty is deleted.
+    static void sweepSegment(MemoryManager::SweptSegment& segment, const HeapPool& pool,
+                             GarbageCollected::State currentWhite, GarbageCollected::State nextWhite)
     {
-        while(m_currgc && steps > 0)
+        for(char* slab : segment.slabs)
         {
-            if(m_currgc->state == m_currentwhite)
+            GarbageCollected* freeList = nullptr;
+            GarbageCollected* freeTail = nullptr;
+            size_t freeSlots = 0;
+
+            for(size_t index = pool.slotsPerSlab; index-- > 0;)
             {
-                m_prevgc->next = m_currgc->next;
-                freeGC(m_currgc);
-                m_currgc = m_prevgc->next;
+                GarbageCollected* gc = (GarbageCollected*)(slab + index * pool.slotSize);
+
+                if(gc->state != GarbageCollected::GC_Free)
+                {
+                    if(gc->state != currentWhite)
+                    {
+                        gc->state = nextWhite;
+                        continue;
+                    }
+
+                    destroyGC(gc);
+                    segment.freedObjects.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                GarbageCollected* freeSlot = new(gc) GarbageCollected(pool.type);
+                freeSlot->state = GarbageCollected::GC_Free;
+                freeSlot->next = freeList;
+
+                freeList = freeSlot;
+                freeTail = freeTail ? freeTail : freeSlot;
+                ++freeSlots;
             }
-            else
+
+            if(freeSlots == pool.slotsPerSlab)
             {
-                m_currgc->state = m_nextwhite;
-                m_prevgc = m_currgc;
-                m_currgc = m_currgc->next;
+                delete[] slab;
+                continue;
             }
 
-            steps -= 1;
+            segment.keptSlabs.push_back(slab);
+
+            if(freeList)
+            {
+                freeTail->next = segment.freeList;
+                segment.freeList = freeList;
+                segment.freeTail = segment.freeTail ? segment.freeTail : freeTail;
+                segment.freeSlots += freeSlots;
+            }
         }
+    }
 
-        return steps;
+    void MemoryManager::startSweep()
+    {
+        // The script resumes as soon as the marking ends. The sweeper thread frees the
+        // white objects of the slabs as they are now, while the pools carry on with new
+        // slabs, and the survivors are made of the next white for the next cycle.
+        for(int i = 0; i < PoolsCount; ++i)
+        {
+            m_swept[i].slabs.swap(m_pools[i].slabs);
+            m_pools[i].freeList = nullptr;
+            m_pools[i].freeSlots = 0;
+        }
+
+        m_sweepdone.store(false);
+
+        m_sweeper = std::thread([this, currentWhite = m_currentwhite, nextWhite = m_nextwhite]()
+        {
+            for(int i = 0; i < PoolsCount; ++i)
+                sweepSegment(m_swept[i], m_pools[i], currentWhite, nextWhite);
+
+            m_sweepdone.store(true, std::memory_order_release);
+        });
+    }
+
+    void MemoryManager::finishSweep()
+    {
+        if(!m_sweeper.joinable())
+            return;
+
+        m_sweeper.join();
+        m_sweepdone.store(false);
+
+        for(int i = 0; i < PoolsCount; ++i)
+        {
+            HeapPool& pool = m_pools[i];
+            SweptSegment& segment = m_swept[i];
+
+            // the older slabs go first, the sweeps find them in address order more often
+            pool.slabs.insert(pool.slabs.begin(), segment.keptSlabs.begin(), segment.keptSlabs.end());
+
+            if(segment.freeList)
+            {
+                segment.freeTail->next = pool.freeList;
+                pool.freeList = segment.freeList;
+                pool.freeSlots += segment.freeSlots;
+            }
+
+            segment.slabs.clear();
+            segment.keptSlabs.clear();
+            segment.freeList = nullptr;
+            segment.freeTail = nullptr;
+            segment.freeSlots = 0;
+        }
+
+        auto takeFreed = [this](Value::Type type) { return m_swept[type - Value::VT_String].freedObjects.exchange(0); };
+
+        m_heapstringscnt -= takeFreed(Value::VT_String);
+        m_heaparrayscnt -= takeFreed(Value::VT_Array);
+        m_heapobjectscnt -= takeFreed(Value::VT_Object);
+        m_heapfunctionscnt -= takeFreed(Value::VT_Function);
+        m_heapboxescnt -= takeFreed(Value::VT_Box);
+        m_heapitercnt -= takeFreed(Value::VT_Iterator);
+        m_heaperrorscnt -= takeFreed(Value::VT_Error);
     }
 
 }// namespace element
@@ -18,7 +18,10 @@ namespace element
             {"type", natfn_type},
             {"this_call", natfn_thiscall},
             {"garbage_collect", natfn_garbagecollect},
+            {"garbage_collect_pacing", natfn_garbagecollectpacing},
+            {"garbage_compact", natfn_garbagecompact},
             {"memory_stats", natfn_memorystats},
+            {"inline_cache_stats", natfn_inlinecachestats},
             {"print", natfn_print},
             {"strtoupper", natfn_toupper},
             {"strtolower", natfn_tolower},
@@ -56,7 +59,7 @@ namespace element
             return allFunctions;
         }
 
-        Value natfn_loadelement(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_loadelement(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -79,7 +82,7 @@ namespace element
             return result;
         }
 
-        Value natfn_addsearchpath(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_addsearchpath(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -92,11 +95,11 @@ namespace element
                 vm.setError("function 'add_search_path(path)' takes a string as an argument");
                 return Value();
             }
-            vm.getFileManager().addSearchPath(path.string->str);
+            vm.getFileManager().addSearchPath(path.string()->str);
             return Value();
        }
 
-        Value natfn_getsearchpaths(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_getsearchpaths(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(!args.empty())
             {
@@ -106,7 +109,7 @@ namespace element
             auto& memoryManager = vm.getMemoryManager();
             auto paths = vm.getFileManager().getSearchPaths();
             Value result = memoryManager.makeArray();
-            result.array->elements.reserve(paths.size());
+            result.array()->elements.reserve(paths.size());
             for(const std::string& path : paths)
             {
                 vm.pushElement(result, memoryManager.makeString(path));
@@ -114,7 +117,7 @@ namespace element
             return result;
        }
 
-        Value natfn_clearsearchpaths(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_clearsearchpaths(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(!args.empty())
             {
@@ -125,7 +128,7 @@ namespace element
             return Value();
        }
 
-        Value natfn_type(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_type(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -135,49 +138,49 @@ namespace element
 
             Value result = vm.getMemoryManager().makeString();
 
-            switch(args[0].type)
+            switch(args[0].type())
             {
                 case Value::VT_Nil:
-                    result.string->str = "nil";
+                    result.string()->str = "nil";
                     break;
                 case Value::VT_Int:
-                    result.string->str = "int";
+                    result.string()->str = "int";
                     break;
                 case Value::VT_Float:
-                    result.string->str = "float";
+                    result.string()->str = "float";
                     break;
                 case Value::VT_Bool:
-                    result.string->str = "bool";
+                    result.string()->str = "bool";
                     break;
                 case Value::VT_String:
-                    result.string->str = "string";
+                    result.string()->str = "string";
                     break;
                 case Value::VT_Array:
-                    result.string->str = "array";
+                    result.string()->str = "array";
                     break;
                 case Value::VT_Object:
-                    result.string->str = "object";
+                    result.string()->str = "object";
                     break;
                 case Value::VT_Function:
-                    result.string->str = "function";
+                    result.string()->str = "function";
                     break;
                 case Value::VT_Iterator:
-                    result.string->str = "iterator";
+                    result.string()->str = "iterator";
                     break;
                 case Value::VT_NativeFunction:
-                    result.string->str = "native-function";
+                    result.string()->str = "native-function";
                     break;
                 case Value::VT_Error:
-                    result.string->str = "error";
+                    result.string()->str = "error";
                     break;
                 default:
-                    result.string->str = "<[???]>";
+                    result.string()->str = "<[???]>";
                     break;
            }
             return result;
        }
 
-        Value natfn_thiscall(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_thiscall(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() < 2)
             {
@@ -209,7 +212,7 @@ namespace element
             return result;
        }
 
-        Value natfn_garbagecollect(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_garbagecollect(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.empty())
             {
@@ -228,10 +231,33 @@ namespace element
             return Value();
        }
 
-        Value natfn_memorystats(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_garbagecollectpacing(VirtualMachine& vm, const Value& thisObject, Arguments args)
+        {
+            if(args.size() != 2 || !args[0].isInt() || !args[1].isInt())
+            {
+                vm.setError("function 'garbage_collect_pacing(growth_percent, step_size)' takes two integers as arguments");
+                return Value();
+           }
+
+            vm.getMemoryManager().setGCGrowth(args[0].toInt());
+            vm.getMemoryManager().setGCStepSize(args[1].toInt());
+
+            return Value();
+       }
+
+        Value natfn_garbagecompact(VirtualMachine& vm, const Value& thisObject, Arguments args)
+        {
+            // the C++ locals of the natives below on the stack must be temporary roots, as for
+            // the minor collections, since the objects that they point to may move
+            return Value(vm.getMemoryManager().compactHeap());
+       }
+
+        Value natfn_memorystats(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             MemoryManager& memoryManager = vm.getMemoryManager();
 
+            memoryManager.finishSweep();// the slabs being swept are not in the pools
+
             int strings = memoryManager.heapObjectsCount(Value::VT_String);
             int arrays = memoryManager.heapObjectsCount(Value::VT_Array);
             int objects = memoryManager.heapObjectsCount(Value::VT_Object);
@@ -252,18 +278,35 @@ namespace element
             vm.setMember(data, "heap_iterators_count", Value(iterators));
             vm.setMember(data, "heap_errors_count", Value(errors));
             vm.setMember(data, "heap_total_count", Value(total));
+            vm.setMember(data, "heap_live_bytes", Value(int(std::min<size_t>(memoryManager.liveHeapBytes(), INT_MAX))));
+
+            // the old objects are kept in slabs, the free slots in them are the fragmentation
+            size_t usedSlots = memoryManager.usedSlotsCount();
+            size_t freeSlots = memoryManager.freeSlotsCount();
+            int fragmentation = usedSlots + freeSlots > 0 ? int(freeSlots * 100 / (usedSlots + freeSlots)) : 0;
+
+            vm.setMember(data, "heap_allocations", Value(int(std::min<uint64_t>(memoryManager.allocationsCount(), INT_MAX))));
+            vm.setMember(data, "heap_slab_bytes", Value(int(std::min<size_t>(memoryManager.slabBytes(), INT_MAX))));
+            vm.setMember(data, "heap_used_slots", Value(int(std::min<size_t>(usedSlots, INT_MAX))));
+            vm.setMember(data, "heap_free_slots", Value(int(std::min<size_t>(freeSlots, INT_MAX))));
+            vm.setMember(data, "heap_fragmentation_percent", Value(fragmentation));
 
             return data;
        }
 
-        Value natfn_chr(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_inlinecachestats(VirtualMachine& vm, const Value& thisObject, Arguments args)
+        {
+            return vm.inlineCacheStats();
+       }
+
+        Value natfn_chr(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             std::string rt;
             rt.push_back(char(args[0].toInt()));
             return vm.getMemoryManager().makeString(rt);
        }
 
-        Value natfn_print(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_print(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             for(const Value& arg : args)
             {
@@ -296,7 +339,7 @@ namespace element
             return int(args.size());
        }
 
-        Value natfn_toupper(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_toupper(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -311,7 +354,7 @@ namespace element
            }
 
             std::locale locale;
-            std::string str = args[0].string->str;
+            std::string str = args[0].string()->str;
 
             unsigned size = str.size();
 
@@ -321,7 +364,7 @@ namespace element
             return vm.getMemoryManager().makeString(str);
        }
 
-        Value natfn_tolower(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_tolower(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -336,7 +379,7 @@ namespace element
            }
 
             std::locale locale;
-            std::string str = args[0].string->str;
+            std::string str = args[0].string()->str;
 
             unsigned size = str.size();
 
@@ -346,7 +389,7 @@ namespace element
             return vm.getMemoryManager().makeString(str);
        }
 
-        Value natfn_keys(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_keys(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -362,16 +405,16 @@ namespace element
 
             MemoryManager& memoryManager = vm.getMemoryManager();
 
-            Object* object = args[0].object;
+            Object* object = args[0].object();
 
             Value keys = memoryManager.makeArray();
             std::string name;
 
-            keys.array->elements.reserve(object->members.size());
+            keys.array()->elements.reserve(object->membersCount());
 
-            for(const Object::Member& member : object->members)
+            for(unsigned slot : object->slotsInHashOrder())
             {
-                if(vm.nameFromHash(member.hash, &name))
+                if(vm.nameFromHash(object->memberHash(slot), &name))
                     vm.pushElement(keys, memoryManager.makeString(name));
 
                 name.clear();
@@ -380,7 +423,7 @@ namespace element
             return keys;
        }
 
-        Value natfn_makeerror(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_makeerror(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -388,7 +431,7 @@ namespace element
                 return Value();
            }
 
-            Value::Type type = args[0].type;
+            Value::Type type = args[0].type();
 
             if(type != Value::VT_String)
             {
@@ -396,12 +439,12 @@ namespace element
                 return Value();
            }
 
-            const std::string& str = args[0].string->str;
+            const std::string& str = args[0].string()->str;
 
             return vm.getMemoryManager().makeError(str);
        }
 
-        Value natfn_iserror(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_iserror(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -412,7 +455,7 @@ namespace element
             return args[0].isError();
        }
 
-        Value natfn_makecoroutine(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_makecoroutine(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -420,7 +463,7 @@ namespace element
                 return Value();
            }
 
-            Value::Type type = args[0].type;
+            Value::Type type = args[0].type();
 
             if(type != Value::VT_Function)
             {
@@ -428,10 +471,26 @@ namespace element
                 return Value();
            }
 
-            return vm.getMemoryManager().makeCoroutine(args[0].function);
+            return vm.getMemoryManager().makeCoroutine(args[0].function());
        }
 
-        Value natfn_makeiterator(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        // The implementation is stored in the iterator, which a minor collection may
+        // move, so the functions are looked up again for every call
+        static Value iteratorHasNext(VirtualMachine& vm, const Value& iterator)
+        {
+            IteratorImplementation* ii = iterator.iterator()->implementation;
+
+            return vm.callMemberFunction(ii->thisObjectUsed, ii->hasNextFunction, {});
+        }
+
+        static Value iteratorGetNext(VirtualMachine& vm, const Value& iterator)
+        {
+            IteratorImplementation* ii = iterator.iterator()->implementation;
+
+            return vm.callMemberFunction(ii->thisObjectUsed, ii->getNextFunction, {});
+        }
+
+        Value natfn_makeiterator(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -444,7 +503,7 @@ namespace element
             if(iterator)
                 return iterator;
 
-            if(args[0].type == Value::VT_Function && args[0].function->executionContext == nullptr)
+            if(args[0].type() == Value::VT_Function && args[0].function()->executionContext == nullptr)
             {
                 vm.setError("function 'make_iterator(value)': Cannot iterate a function. Only coroutine instances are iterable.");
            }
@@ -456,7 +515,7 @@ namespace element
             return Value();
        }
 
-        Value natfn_iteratorhasnext(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_iteratorhasnext(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -464,15 +523,13 @@ namespace element
                 return Value();
            }
 
-            if(args[0].type != Value::VT_Iterator)
+            if(args[0].type() != Value::VT_Iterator)
             {
                 vm.setError("function 'iterator_get_next(iterator)' takes an iterator as a first argument");
                 return Value();
            }
 
-            IteratorImplementation* ii = args[0].iterator->implementation;
-
-            Value result = vm.callMemberFunction(ii->thisObjectUsed, ii->hasNextFunction, {});
+            Value result = iteratorHasNext(vm, args[0]);
 
             if(vm.hasError())
                 return Value();
@@ -480,7 +537,7 @@ namespace element
             return result;
        }
 
-        Value natfn_iteratorgetnext(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_iteratorgetnext(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -488,15 +545,13 @@ namespace element
                 return Value();
            }
 
-            if(args[0].type != Value::VT_Iterator)
+            if(args[0].type() != Value::VT_Iterator)
             {
                 vm.setError("function 'iterator_get_next(iterator)' takes an iterator as a first argument");
                 return Value();
            }
 
-            IteratorImplementation* ii = args[0].iterator->implementation;
-
-            Value result = vm.callMemberFunction(ii->thisObjectUsed, ii->getNextFunction, {});
+            Value result = iteratorGetNext(vm, args[0]);
 
             if(vm.hasError())
                 return Value();
@@ -504,35 +559,7 @@ namespace element
             return result;
        }
 
-        struct RangeIterator : public IteratorImplementation
-        {
-            int from = 0;
-            int to = 0;
-            int step = 1;
-
-            RangeIterator()
-            {
-                hasNextFunction = Value(
-                [](VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args) -> Value
-                {
-                    RangeIterator* self = static_cast<RangeIterator*>(thisObject.iterator->implementation);
-
-                    return self->from < self->to;
-               });
-
-                getNextFunction = Value(
-                [](VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args) -> Value
-                {
-                    RangeIterator* self = static_cast<RangeIterator*>(thisObject.iterator->implementation);
-
-                    int result = self->from;
-                    self->from += self->step;
-                    return result;
-               });
-           }
-       };
-
-        Value natfn_range(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)// TODO check for reversed ranges like 'range(10, 0)'
+        Value natfn_range(VirtualMachine& vm, const Value& thisObject, Arguments args)// TODO check for reversed ranges like 'range(10, 0)'
         {
             if(args.size() == 1)
             {
@@ -542,11 +569,12 @@ namespace element
                     return Value();
                }
 
-                RangeIterator* rangeIterator = new RangeIterator();
+                Iterator* iterator = vm.getMemoryManager().makeIterator<RangeIterator>();
+                RangeIterator* rangeIterator = static_cast<RangeIterator*>(iterator->implementation);
 
                 rangeIterator->to = args[0].toInt();
 
-                return vm.getMemoryManager().makeIterator(rangeIterator);
+                return iterator;
            }
             else if(args.size() == 2)
             {
@@ -556,12 +584,13 @@ namespace element
                     return Value();
                }
 
-                RangeIterator* rangeIterator = new RangeIterator();
+                Iterator* iterator = vm.getMemoryManager().makeIterator<RangeIterator>();
+                RangeIterator* rangeIterator = static_cast<RangeIterator*>(iterator->implementation);
 
                 rangeIterator->from = args[0].toInt();
                 rangeIterator->to = args[1].toInt();
 
-                return vm.getMemoryManager().makeIterator(rangeIterator);
+                return iterator;
            }
             else if(args.size() == 3)
             {
@@ -571,20 +600,21 @@ namespace element
                     return Value();
                }
 
-                RangeIterator* rangeIterator = new RangeIterator();
+                Iterator* iterator = vm.getMemoryManager().makeIterator<RangeIterator>();
+                RangeIterator* rangeIterator = static_cast<RangeIterator*>(iterator->implementation);
 
                 rangeIterator->from = args[0].toInt();
                 rangeIterator->to = args[1].toInt();
                 rangeIterator->step = args[2].toInt();
 
-                return vm.getMemoryManager().makeIterator(rangeIterator);
+                return iterator;
            }
 
             vm.setError("'range' can only be 'range(max)', 'range(min,max)' or 'range(min,max,step)'");
             return Value();
        }
 
-        Value natfn_each(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_each(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 2)
             {
@@ -603,14 +633,15 @@ namespace element
             if(Iterator* iterator = vm.makeIterator(args[0]))
             {
                 Value result;
-                std::vector<Value> noArgs;
-                Value& objectUsed = iterator->implementation->thisObjectUsed;
-                Value& hasNext = iterator->implementation->hasNextFunction;
-                Value& getNext = iterator->implementation->getNextFunction;
+
+                Value iterated = iterator;
+
+                // the collector may run in the callbacks
+                TemporaryRoots roots(vm.getMemoryManager(), {&iterated});
 
                 while(true)
                 {
-                    result = vm.callMemberFunction(objectUsed, hasNext, noArgs);
+                    result = iteratorHasNext(vm, iterated);
 
                     if(vm.hasError())
                         return Value();
@@ -618,12 +649,13 @@ namespace element
                     if(!result.asBool())
                         break;
 
-                    result = vm.callMemberFunction(objectUsed, getNext, noArgs);
+                    result = iteratorGetNext(vm, iterated);
 
                     if(vm.hasError())
                         return Value();
 
-                    vm.callFunction(function, {result});
+                    Value arguments[] = { result };
+                    vm.callFunction(function, arguments);
 
                     if(vm.hasError())
                         return Value();
@@ -637,7 +669,7 @@ namespace element
             return Value();
        }
 
-        Value natfn_times(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_times(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 2)
             {
@@ -662,7 +694,8 @@ namespace element
 
             for(int i = 0; i < times; ++i)
             {
-                vm.callFunction(function, {i});
+                Value arguments[] = { i };
+                vm.callFunction(function, arguments);
 
                 if(vm.hasError())
                     return Value();
@@ -671,7 +704,7 @@ namespace element
             return Value();
        }
 
-        Value natfn_count(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_count(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 2)
             {
@@ -690,16 +723,17 @@ namespace element
             if(Iterator* iterator = vm.makeIterator(args[0]))
             {
                 Value result;
-                std::vector<Value> noArgs;
-                Value& objectUsed = iterator->implementation->thisObjectUsed;
-                Value& hasNext = iterator->implementation->hasNextFunction;
-                Value& getNext = iterator->implementation->getNextFunction;
+
+                Value iterated = iterator;
+
+                // the collector may run in the callbacks
+                TemporaryRoots roots(vm.getMemoryManager(), {&iterated});
 
                 int counter = 0;
 
                 while(true)
                 {
-                    result = vm.callMemberFunction(objectUsed, hasNext, noArgs);
+                    result = iteratorHasNext(vm, iterated);
 
                     if(vm.hasError())
                         return Value();
@@ -707,12 +741,13 @@ namespace element
                     if(!result.asBool())
                         break;
 
-                    result = vm.callMemberFunction(objectUsed, getNext, noArgs);
+                    result = iteratorGetNext(vm, iterated);
 
                     if(vm.hasError())
                         return Value();
 
-                    result = vm.callFunction(function, {result});
+                    Value arguments[] = { result };
+                    result = vm.callFunction(function, arguments);
 
                     if(vm.hasError())
                         return Value();
@@ -728,7 +763,7 @@ namespace element
             return Value();
        }
 
-        Value natfn_map(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_map(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 2)
             {
@@ -747,16 +782,16 @@ namespace element
             if(Iterator* iterator = vm.makeIterator(args[0]))
             {
                 Value result;
-                std::vector<Value> noArgs;
-                Value& objectUsed = iterator->implementation->thisObjectUsed;
-                Value& hasNext = iterator->implementation->hasNextFunction;
-                Value& getNext = iterator->implementation->getNextFunction;
 
+                Value iterated = iterator;
                 Value mapped = vm.getMemoryManager().makeArray();
 
+                // the collector may run in the callbacks
+                TemporaryRoots roots(vm.getMemoryManager(), {&iterated, &mapped});
+
                 while(true)
                 {
-                    result = vm.callMemberFunction(objectUsed, hasNext, noArgs);
+                    result = iteratorHasNext(vm, iterated);
 
                     if(vm.hasError())
                         return Value();
@@ -764,12 +799,13 @@ namespace element
                     if(!result.asBool())
                         break;
 
-                    result = vm.callMemberFunction(objectUsed, getNext, noArgs);
+                    result = iteratorGetNext(vm, iterated);
 
                     if(vm.hasError())
                         return Value();
 
-                    result = vm.callFunction(function, {result});
+                    Value arguments[] = { result };
+                    result = vm.callFunction(function, arguments);
 
                     if(vm.hasError())
                         return Value();
@@ -784,7 +820,7 @@ namespace element
             return Value();
        }
 
-        Value natfn_filter(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_filter(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 2)
             {
@@ -804,16 +840,16 @@ namespace element
             {
                 Value result;
                 Value item;
-                std::vector<Value> noArgs;
-                Value& objectUsed = iterator->implementation->thisObjectUsed;
-                Value& hasNext = iterator->implementation->hasNextFunction;
-                Value& getNext = iterator->implementation->getNextFunction;
 
+                Value iterated = iterator;
                 Value filtered = vm.getMemoryManager().makeArray();
 
+                // the collector may run in the callbacks
+                TemporaryRoots roots(vm.getMemoryManager(), {&iterated, &item, &filtered});
+
                 while(true)
                 {
-                    result = vm.callMemberFunction(objectUsed, hasNext, noArgs);
+                    result = iteratorHasNext(vm, iterated);
 
                     if(vm.hasError())
                         return Value();
@@ -821,12 +857,13 @@ namespace element
                     if(!result.asBool())
                         break;
 
-                    item = vm.callMemberFunction(objectUsed, getNext, noArgs);
+                    item = iteratorGetNext(vm, iterated);
 
                     if(vm.hasError())
                         return Value();
 
-                    result = vm.callFunction(function, {item});
+                    Value arguments[] = { item };
+                    result = vm.callFunction(function, arguments);
 
                     if(vm.hasError())
                         return Value();
@@ -842,7 +879,7 @@ namespace element
             return Value();
        }
 
-        Value natfn_reduce(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_reduce(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 2)
             {
@@ -861,24 +898,25 @@ namespace element
             if(Iterator* iterator = vm.makeIterator(args[0]))
             {
                 Value result;
-                std::vector<Value> noArgs;
-                Value& objectUsed = iterator->implementation->thisObjectUsed;
-                Value& hasNext = iterator->implementation->hasNextFunction;
-                Value& getNext = iterator->implementation->getNextFunction;
 
+                Value iterated = iterator;
                 Value reduced;
-                result = vm.callMemberFunction(objectUsed, hasNext, noArgs);
+
+                // the collector may run in the callbacks
+                TemporaryRoots roots(vm.getMemoryManager(), {&iterated, &reduced});
+
+                result = iteratorHasNext(vm, iterated);
 
                 if(vm.hasError())
                     return Value();
 
                 if(result.asBool())
                 {
-                    reduced = vm.callMemberFunction(objectUsed, getNext, noArgs);
+                    reduced = iteratorGetNext(vm, iterated);
 
                     while(true)
                     {
-                        result = vm.callMemberFunction(objectUsed, hasNext, noArgs);
+                        result = iteratorHasNext(vm, iterated);
 
                         if(vm.hasError())
                             return Value();
@@ -886,12 +924,13 @@ namespace element
                         if(!result.asBool())
                             break;
 
-                        result = vm.callMemberFunction(objectUsed, getNext, noArgs);
+                        result = iteratorGetNext(vm, iterated);
 
                         if(vm.hasError())
                             return Value();
 
-                        reduced = vm.callFunction(function, {reduced, result});
+                        Value arguments[] = { reduced, result };
+                        reduced = vm.callFunction(function, arguments);
 
                         if(vm.hasError())
                             return Value();
@@ -905,7 +944,7 @@ namespace element
             return Value();
        }
 
-        Value natfn_all(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_all(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             unsigned argsSize = args.size();
 
@@ -918,16 +957,17 @@ namespace element
             if(Iterator* iterator = vm.makeIterator(args[0]))
             {
                 Value result;
-                std::vector<Value> noArgs;
-                Value& objectUsed = iterator->implementation->thisObjectUsed;
-                Value& hasNext = iterator->implementation->hasNextFunction;
-                Value& getNext = iterator->implementation->getNextFunction;
+
+                Value iterated = iterator;
+
+                // the collector may run in the callbacks
+                TemporaryRoots roots(vm.getMemoryManager(), {&iterated});
 
                 if(argsSize == 1)
                 {
                     while(true)
                     {
-                        result = vm.callMemberFunction(objectUsed, hasNext, noArgs);
+                        result = iteratorHasNext(vm, iterated);
 
                         if(vm.hasError())
                             return Value();
@@ -935,7 +975,7 @@ namespace element
                         if(!result.asBool())
                             break;
 
-                        result = vm.callMemberFunction(objectUsed, getNext, noArgs);
+                        result = iteratorGetNext(vm, iterated);
 
                         if(vm.hasError())
                             return Value();
@@ -958,7 +998,7 @@ namespace element
 
                     while(true)
                     {
-                        result = vm.callMemberFunction(objectUsed, hasNext, noArgs);
+                        result = iteratorHasNext(vm, iterated);
 
                         if(vm.hasError())
                             return Value();
@@ -966,12 +1006,13 @@ namespace element
                         if(!result.asBool())
                             break;
 
-                        result = vm.callMemberFunction(objectUsed, getNext, noArgs);
+                        result = iteratorGetNext(vm, iterated);
 
                         if(vm.hasError())
                             return Value();
 
-                        result = vm.callFunction(function, {result});
+                        Value arguments[] = { result };
+                        result = vm.callFunction(function, arguments);
 
                         if(vm.hasError())
                             return Value();
@@ -988,7 +1029,7 @@ namespace element
             return Value();
        }
 
-        Value natfn_any(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_any(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             unsigned argsSize = args.size();
 
@@ -1001,16 +1042,17 @@ namespace element
             if(Iterator* iterator = vm.makeIterator(args[0]))
             {
                 Value result;
-                std::vector<Value> noArgs;
-                Value& objectUsed = iterator->implementation->thisObjectUsed;
-                Value& hasNext = iterator->implementation->hasNextFunction;
-                Value& getNext = iterator->implementation->getNextFunction;
+
+                Value iterated = iterator;
+
+                // the collector may run in the callbacks
+                TemporaryRoots roots(vm.getMemoryManager(), {&iterated});
 
                 if(argsSize == 1)
                 {
                     while(true)
                     {
-                        result = vm.callMemberFunction(objectUsed, hasNext, noArgs);
+                        result = iteratorHasNext(vm, iterated);
 
                         if(vm.hasError())
                             return Value();
@@ -1018,7 +1060,7 @@ namespace element
                         if(!result.asBool())
                             break;
 
-                        result = vm.callMemberFunction(objectUsed, getNext, noArgs);
+                        result = iteratorGetNext(vm, iterated);
 
                         if(vm.hasError())
                             return Value();
@@ -1041,7 +1083,7 @@ namespace element
 
                     while(true)
                     {
-                        result = vm.callMemberFunction(objectUsed, hasNext, noArgs);
+                        result = iteratorHasNext(vm, iterated);
 
                         if(vm.hasError())
                             return Value();
@@ -1049,12 +1091,13 @@ namespace element
                         if(!result.asBool())
                             break;
 
-                        result = vm.callMemberFunction(objectUsed, getNext, noArgs);
+                        result = iteratorGetNext(vm, iterated);
 
                         if(vm.hasError())
                             return Value();
 
-                        result = vm.callFunction(function, {result});
+                        Value arguments[] = { result };
+                        result = vm.callFunction(function, arguments);
 
                         if(vm.hasError())
                             return Value();
@@ -1071,25 +1114,25 @@ namespace element
             return Value();
        }
 
-        Value natfn_min(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_min(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             vm.setError("function 'min' is not implemented");
             return Value();
        }
 
-        Value natfn_max(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_max(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             vm.setError("function 'max' is not implemented");
             return Value();
        }
 
-        Value natfn_sort(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_sort(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             vm.setError("function 'sort' is not implemented");
             return Value();
        }
 
-        Value natfn_abs(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_abs(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -1107,7 +1150,7 @@ namespace element
             return std::abs(args[0].asFloat());
        }
 
-        Value natfn_floor(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_floor(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -1123,7 +1166,7 @@ namespace element
             return std::floor(args[0].asFloat());
        }
 
-        Value natfn_ceil(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_ceil(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -1139,7 +1182,7 @@ namespace element
             return std::ceil(args[0].asFloat());
        }
 
-        Value natfn_round(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_round(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -1155,7 +1198,7 @@ namespace element
             return std::round(args[0].asFloat());
        }
 
-        Value natfn_sqrt(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_sqrt(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -1171,7 +1214,7 @@ namespace element
             return std::sqrt(args[0].asFloat());
        }
 
-        Value natfn_sin(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_sin(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -1187,7 +1230,7 @@ namespace element
             return std::sin(args[0].asFloat());
        }
 
-        Value natfn_cos(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_cos(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -1203,7 +1246,7 @@ namespace element
             return std::cos(args[0].asFloat());
        }
 
-        Value natfn_tan(VirtualMachine& vm, const Value& thisObject, const std::vector<Value>& args)
+        Value natfn_tan(VirtualMachine& vm, const Value& thisObject, Arguments args)
         {
             if(args.size() != 1)
             {
@@ -2,10 +2,18 @@
 
 namespace element
 {
-    Instruction::Instruction(OpCode opCode, int A) : opCode(opCode), A(A)
+    Instruction::Instruction(OpCode opCode, int A, int B, int C) : opCode(opCode), B((unsigned char)B), C((unsigned short)C), A(A)
     {
     }
 
+    bool isJump(OpCode opCode)
+    {
+        return opCode == OpCode::OC_Jump || opCode == OpCode::OC_JumpIfFalse || opCode == OpCode::OC_PopJumpIfFalse
+               || opCode == OpCode::OC_JumpIfFalseOrPop || opCode == OpCode::OC_JumpIfTrueOrPop
+               || opCode == OpCode::OC_ForIter || opCode == OpCode::OC_ForRange
+               || (opCode >= OpCode::OC_EqualRegistersJump && opCode <= OpCode::OC_GreaterEqualRegisterConstantJump);
+    }
+
     std::string Instruction::asString() const
     {
         using namespace std::string_literals;
@@ -18,8 +26,8 @@ namespace element
                 return "PopN              "s + std::to_string(int(A));
             case OpCode::OC_Rotate2:
                 return "Rotate2";
-            case OpCode::OC_MoveToTOS2:
-                return "MoveToTOS2";
+            case OpCode::OC_MoveToTOSN:
+                return "MoveToTOSN        "s + std::to_string(int(A));
             case OpCode::OC_Duplicate:
                 return "Duplicate";
             case OpCode::OC_Unpack:
@@ -73,6 +81,8 @@ namespace element
 
             case OpCode::OC_MakeIterator:
                 return "MakeIterator";
+            case OpCode::OC_MakeRange:
+                return "MakeRange         "s + std::to_string(int(A));
             case OpCode::OC_IteratorHasNext:
                 return "IteratorHasNext";
             case OpCode::OC_IteratorGetNext:
@@ -95,6 +105,10 @@ namespace element
             case OpCode::OC_PopStoreToClosure:
                 return "PopStoreToClosure "s + std::to_string(int(A));
 
+            case OpCode::OC_ForRange:
+                return "ForRange          "s + std::to_string(int(A));
+            case OpCode::OC_ForIter:
+                return "ForIter           "s + std::to_string(int(A));
             case OpCode::OC_Jump:
                 return "Jump              "s + std::to_string(int(A));
             case OpCode::OC_JumpIfFalse:
@@ -158,6 +172,107 @@ namespace element
             case OpCode::OC_UnarySizeOf:
                 return "UnarySizeOf";
 
+            case OpCode::OC_AddIntInt:
+                return "AddIntInt";
+            case OpCode::OC_AddFloatFloat:
+                return "AddFloatFloat";
+            case OpCode::OC_SubtractIntInt:
+                return "SubtractIntInt";
+            case OpCode::OC_SubtractFloatFloat:
+                return "SubtractFloatFloat";
+            case OpCode::OC_MultiplyIntInt:
+                return "MultiplyIntInt";
+            case OpCode::OC_MultiplyFloatFloat:
+                return "MultiplyFloatFloat";
+            case OpCode::OC_DivideIntInt:
+                return "DivideIntInt";
+            case OpCode::OC_DivideFloatFloat:
+                return "DivideFloatFloat";
+            case OpCode::OC_ModuloIntInt:
+                return "ModuloIntInt";
+            case OpCode::OC_ConcatenateStrStr:
+                return "ConcatenateStrStr";
+            case OpCode::OC_EqualIntInt:
+                return "EqualIntInt";
+            case OpCode::OC_NotEqualIntInt:
+                return "NotEqualIntInt";
+            case OpCode::OC_LessIntInt:
+                return "LessIntInt";
+            case OpCode::OC_LessFloatFloat:
+                return "LessFloatFloat";
+            case OpCode::OC_GreaterIntInt:
+                return "GreaterIntInt";
+            case OpCode::OC_GreaterFloatFloat:
+                return "GreaterFloatFloat";
+            case OpCode::OC_LessEqualIntInt:
+                return "LessEqualIntInt";
+            case OpCode::OC_LessEqualFloatFloat:
+                return "LessEqualFloatFloat";
+            case OpCode::OC_GreaterEqualIntInt:
+                return "GreaterEqualIntInt";
+            case OpCode::OC_GreaterEqualFloatFloat:
+                return "GreaterEqualFloatFloat";
+
+            case OpCode::OC_LoadLocalLocal:
+                return "LoadLocalLocal    "s + std::to_string(int(A));
+            case OpCode::OC_LoadGlobalGlobal:
+                return "LoadGlobalGlobal  "s + std::to_string(int(A));
+            case OpCode::OC_LoadLocalConstant:
+                return "LoadLocalConstant "s + std::to_string(int(A));
+            case OpCode::OC_AddLocalLocal:
+                return "AddLocalLocal     "s + std::to_string(int(A));
+            case OpCode::OC_AddLocalConstantStore:
+                return "AddLocalConstantStore "s + std::to_string(int(A));
+            case OpCode::OC_LessLocalConstantJump:
+                return "LessLocalConstantJump "s + std::to_string(int(A));
+            case OpCode::OC_LoadHashMember:
+                return "LoadHashMember    "s + std::to_string(unsigned(H));
+
+            case OpCode::OC_MoveRegister:
+                return "MoveRegister      "s + std::to_string(int(A)) + " " + std::to_string(int(C));
+            case OpCode::OC_MoveConstant:
+                return "MoveConstant      "s + std::to_string(int(A)) + " " + std::to_string(int(C));
+            case OpCode::OC_AddRegisters:
+                return "AddRegisters      "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_AddRegisterConstant:
+                return "AddRegisterConstant "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_SubtractRegisters:
+                return "SubtractRegisters "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_SubtractRegisterConstant:
+                return "SubtractRegisterConstant "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_MultiplyRegisters:
+                return "MultiplyRegisters "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_MultiplyRegisterConstant:
+                return "MultiplyRegisterConstant "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_DivideRegisters:
+                return "DivideRegisters   "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_DivideRegisterConstant:
+                return "DivideRegisterConstant "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_EqualRegistersJump:
+                return "EqualRegistersJump "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_EqualRegisterConstantJump:
+                return "EqualRegisterConstantJump "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_NotEqualRegistersJump:
+                return "NotEqualRegistersJump "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_NotEqualRegisterConstantJump:
+                return "NotEqualRegisterConstantJump "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_LessRegistersJump:
+                return "LessRegistersJump "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_LessRegisterConstantJump:
+                return "LessRegisterConstantJump "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_GreaterRegistersJump:
+                return "GreaterRegistersJump "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_GreaterRegisterConstantJump:
+                return "GreaterRegisterConstantJump "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_LessEqualRegistersJump:
+                return "LessEqualRegistersJump "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_LessEqualRegisterConstantJump:
+                return "LessEqualRegisterConstantJump "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_GreaterEqualRegistersJump:
+                return "GreaterEqualRegistersJump "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+            case OpCode::OC_GreaterEqualRegisterConstantJump:
+                return "GreaterEqualRegisterConstantJump "s + std::to_string(int(A)) + " " + std::to_string(int(B)) + " " + std::to_string(int(C));
+
             default:
                 return "Unknown op code "s + std::to_string(int(opCode));
         }
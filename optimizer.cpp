@@ -0,0 +1,583 @@
+#include "element.h"
+
+namespace element
+{
+    // the literals are the only nodes folded, a number keeps whether it was a float
+    struct FoldedNumber
+    {
+        bool isFloat;
+        int integer;
+        double floatingPoint;
+
+        double asFloat() const { return isFloat ? floatingPoint : double(integer); }
+    };
+
+    static bool isLiteral(const std::shared_ptr<ast::Node>& node)
+    {
+        return node->type == ast::Node::N_Nil || node->type == ast::Node::N_Integer || node->type == ast::Node::N_Float
+               || node->type == ast::Node::N_Bool || node->type == ast::Node::N_String;
+    }
+
+    static bool literalNumber(const std::shared_ptr<ast::Node>& node, FoldedNumber* number)
+    {
+        if(node->type == ast::Node::N_Integer)
+        {
+            *number = { false, std::dynamic_pointer_cast<ast::IntegerNode>(node)->value, 0.0 };
+            return true;
+        }
+
+        if(node->type == ast::Node::N_Float)
+        {
+            *number = { true, 0, std::dynamic_pointer_cast<ast::FloatNode>(node)->value };
+            return true;
+        }
+
+        return false;
+    }
+
+    // same as Value::asBool
+    static bool literalAsBool(const std::shared_ptr<ast::Node>& node)
+    {
+        if(node->type == ast::Node::N_Bool)
+            return std::dynamic_pointer_cast<ast::BoolNode>(node)->value;
+
+        return node->type != ast::Node::N_Nil;
+    }
+
+    // same as Value::asString
+    static std::string literalAsString(const std::shared_ptr<ast::Node>& node)
+    {
+        switch(node->type)
+        {
+            case ast::Node::N_Integer:
+                return std::to_string(std::dynamic_pointer_cast<ast::IntegerNode>(node)->value);
+            case ast::Node::N_Float:
+                return std::to_string(std::dynamic_pointer_cast<ast::FloatNode>(node)->value);
+            case ast::Node::N_Bool:
+                return std::dynamic_pointer_cast<ast::BoolNode>(node)->value ? "true" : "false";
+            case ast::Node::N_String:
+                return std::dynamic_pointer_cast<ast::StringNode>(node)->value;
+            default:
+                return "nil";
+        }
+    }
+
+    static std::shared_ptr<ast::Node> copyLiteral(const std::shared_ptr<ast::Node>& node, const Location& coords)
+    {
+        switch(node->type)
+        {
+            case ast::Node::N_Integer:
+                return std::make_shared<ast::IntegerNode>(std::dynamic_pointer_cast<ast::IntegerNode>(node)->value, coords);
+            case ast::Node::N_Float:
+                return std::make_shared<ast::FloatNode>(std::dynamic_pointer_cast<ast::FloatNode>(node)->value, coords);
+            case ast::Node::N_Bool:
+                return std::make_shared<ast::BoolNode>(std::dynamic_pointer_cast<ast::BoolNode>(node)->value, coords);
+            case ast::Node::N_String:
+                return std::make_shared<ast::StringNode>(std::dynamic_pointer_cast<ast::StringNode>(node)->value, coords);
+            default:
+                return std::make_shared<ast::Node>(ast::Node::N_Nil, coords);
+        }
+    }
+
+    // a NaN does not survive the constants and -0.0 would be merged with 0.0, keep computing those
+    static std::shared_ptr<ast::Node> makeFloat(double f, const Location& coords)
+    {
+        if(std::isnan(f) || (f == 0.0 && std::signbit(f)))
+            return nullptr;
+
+        return std::make_shared<ast::FloatNode>(f, coords);
+    }
+
+    static std::shared_ptr<ast::Node> makeInteger(long long i, const Location& coords)
+    {
+        if(i < INT_MIN || i > INT_MAX)// the VM would overflow
+            return nullptr;
+
+        return std::make_shared<ast::IntegerNode>(int(i), coords);
+    }
+
+    Optimizer::Optimizer() : m_currfuncnode(nullptr)
+    {
+    }
+
+    void Optimizer::optimize(const std::shared_ptr<ast::FunctionNode>& node)
+    {
+        m_currfuncnode = nullptr;
+        countStores(node);
+
+        std::shared_ptr<ast::Node> root = node;
+        optimizeNode(root);
+
+        m_storescount.clear();
+        m_constvars.clear();
+    }
+
+    void Optimizer::countStores(const std::shared_ptr<ast::Node>& node)
+    {
+        if(!node)
+            return;
+
+        switch(node->type)
+        {
+            case ast::Node::N_Arguments:
+                for(auto& argument : std::dynamic_pointer_cast<ast::ArgumentsNode>(node)->arguments)
+                    countStores(argument);
+                break;
+
+            case ast::Node::N_UnaryOperator:
+                countStores(std::dynamic_pointer_cast<ast::UnaryOperatorNode>(node)->operand);
+                break;
+
+            case ast::Node::N_BinaryOperator:
+            {
+                auto n = std::dynamic_pointer_cast<ast::BinaryOperatorNode>(node);
+
+                if(n->op == T_Assignment || n->op == T_AssignAdd || n->op == T_AssignSubtract || n->op == T_AssignMultiply
+                   || n->op == T_AssignDivide || n->op == T_AssignConcatenate || n->op == T_AssignPower || n->op == T_AssignModulo)
+                    countStoreTarget(n->lhs);
+                else if(n->op == T_ArrayPopBack)
+                    countStoreTarget(n->rhs);
+
+                countStores(n->lhs);
+                if(n->op != T_Dot)// the member name is not a variable
+                    countStores(n->rhs);
+                break;
+            }
+
+            case ast::Node::N_If:
+            {
+                auto n = std::dynamic_pointer_cast<ast::IfNode>(node);
+                countStores(n->condition);
+                countStores(n->thenPath);
+                countStores(n->elsePath);
+                break;
+            }
+
+            case ast::Node::N_While:
+            {
+                auto n = std::dynamic_pointer_cast<ast::WhileNode>(node);
+                countStores(n->condition);
+                countStores(n->body);
+                break;
+            }
+
+            case ast::Node::N_For:
+            {
+                auto n = std::dynamic_pointer_cast<ast::ForNode>(node);
+                countStoreTarget(n->iteratingVariable);
+                countStores(n->iteratedExpression);
+                countStores(n->body);
+                break;
+            }
+
+            case ast::Node::N_Block:
+                for(auto& it : std::dynamic_pointer_cast<ast::BlockNode>(node)->nodes)
+                    countStores(it);
+                break;
+
+            case ast::Node::N_Array:
+                for(auto& it : std::dynamic_pointer_cast<ast::ArrayNode>(node)->elements)
+                    countStores(it);
+                break;
+
+            case ast::Node::N_Object:
+                for(auto& it : std::dynamic_pointer_cast<ast::ObjectNode>(node)->members)
+                    countStores(it.second);// the keys are member names, not variables
+                break;
+
+            case ast::Node::N_Function:
+            {
+                auto n = std::dynamic_pointer_cast<ast::FunctionNode>(node);
+
+                auto oldFunctionNode = m_currfuncnode;
+                m_currfuncnode = n.get();
+
+                countStores(n->body);
+
+                m_currfuncnode = oldFunctionNode;
+                break;
+            }
+
+            case ast::Node::N_FunctionCall:
+            {
+                auto n = std::dynamic_pointer_cast<ast::FunctionCallNode>(node);
+                countStores(n->function);
+                countStores(n->arguments);
+                break;
+            }
+
+            case ast::Node::N_Return:
+                countStores(std::dynamic_pointer_cast<ast::ReturnNode>(node)->value);
+                break;
+
+            case ast::Node::N_Break:
+                countStores(std::dynamic_pointer_cast<ast::BreakNode>(node)->value);
+                break;
+
+            case ast::Node::N_Continue:
+                countStores(std::dynamic_pointer_cast<ast::ContinueNode>(node)->value);
+                break;
+
+            case ast::Node::N_Yield:
+                countStores(std::dynamic_pointer_cast<ast::YieldNode>(node)->value);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    void Optimizer::countStoreTarget(const std::shared_ptr<ast::Node>& target)
+    {
+        if(target->type == ast::Node::N_Array)// unpacking into each of the elements
+        {
+            for(auto& element : std::dynamic_pointer_cast<ast::ArrayNode>(target)->elements)
+                countStoreTarget(element);
+            return;
+        }
+
+        VariableKey key;
+
+        if(propagatedKey(target, &key))
+            ++m_storescount[key];
+    }
+
+    bool Optimizer::propagatedKey(const std::shared_ptr<ast::Node>& node, VariableKey* key) const
+    {
+        if(node->type != ast::Node::N_Variable)
+            return false;
+
+        auto n = std::dynamic_pointer_cast<ast::VariableNode>(node);
+
+        if(n->variableType != ast::VariableNode::V_Named)
+            return false;
+
+        // the boxed locals and the free variables are shared with the closures
+        if(n->semanticType == ast::VariableNode::SMT_Global)
+            *key = { nullptr, n->index };
+        else if(n->semanticType == ast::VariableNode::SMT_Local)
+            *key = { m_currfuncnode, n->index };
+        else
+            return false;
+
+        return true;
+    }
+
+    void Optimizer::optimizeNode(std::shared_ptr<ast::Node>& node)
+    {
+        if(!node)
+            return;
+
+        switch(node->type)
+        {
+            case ast::Node::N_Variable:
+            {
+                VariableKey key;
+
+                if(!propagatedKey(node, &key) || std::dynamic_pointer_cast<ast::VariableNode>(node)->firstOccurrence)
+                    break;
+
+                auto it = m_constvars.find(key);
+
+                if(it != m_constvars.end())
+                    node = copyLiteral(it->second, node->coords);
+                break;
+            }
+
+            case ast::Node::N_Arguments:
+                for(auto& argument : std::dynamic_pointer_cast<ast::ArgumentsNode>(node)->arguments)
+                    optimizeNode(argument);
+                break;
+
+            case ast::Node::N_UnaryOperator:
+            {
+                auto n = std::dynamic_pointer_cast<ast::UnaryOperatorNode>(node);
+
+                optimizeNode(n->operand);
+
+                if(auto folded = foldUnaryOperator(n))
+                    node = folded;
+                break;
+            }
+
+            case ast::Node::N_BinaryOperator:
+            {
+                auto n = std::dynamic_pointer_cast<ast::BinaryOperatorNode>(node);
+
+                if(n->op == T_Assignment || n->op == T_AssignAdd || n->op == T_AssignSubtract || n->op == T_AssignMultiply
+                   || n->op == T_AssignDivide || n->op == T_AssignConcatenate || n->op == T_AssignPower || n->op == T_AssignModulo)
+                {
+                    // only the array and the index or the object of a stored element are loaded
+                    if(n->lhs->type == ast::Node::N_BinaryOperator)
+                        optimizeNode(n->lhs);
+
+                    optimizeNode(n->rhs);
+                    break;
+                }
+
+                if(n->op == T_ArrayPopBack)// the right hand side is stored into
+                {
+                    optimizeNode(n->lhs);
+                    break;
+                }
+
+                optimizeNode(n->lhs);
+                if(n->op != T_Dot)// the member name is not a variable
+                    optimizeNode(n->rhs);
+
+                if(auto folded = foldBinaryOperator(n))
+                    node = folded;
+                break;
+            }
+
+            case ast::Node::N_If:
+            {
+                auto n = std::dynamic_pointer_cast<ast::IfNode>(node);
+                optimizeNode(n->condition);
+                optimizeNode(n->thenPath);
+                optimizeNode(n->elsePath);
+                break;
+            }
+
+            case ast::Node::N_While:
+            {
+                auto n = std::dynamic_pointer_cast<ast::WhileNode>(node);
+                optimizeNode(n->condition);
+                optimizeNode(n->body);
+                break;
+            }
+
+            case ast::Node::N_For:
+            {
+                auto n = std::dynamic_pointer_cast<ast::ForNode>(node);
+                optimizeNode(n->iteratedExpression);
+                optimizeNode(n->body);
+                break;
+            }
+
+            case ast::Node::N_Block:
+                optimizeBlock(std::dynamic_pointer_cast<ast::BlockNode>(node));
+                break;
+
+            case ast::Node::N_Array:
+                for(auto& it : std::dynamic_pointer_cast<ast::ArrayNode>(node)->elements)
+                    optimizeNode(it);
+                break;
+
+            case ast::Node::N_Object:
+                for(auto& it : std::dynamic_pointer_cast<ast::ObjectNode>(node)->members)
+                    optimizeNode(it.second);
+                break;
+
+            case ast::Node::N_Function:
+            {
+                auto n = std::dynamic_pointer_cast<ast::FunctionNode>(node);
+
+                auto oldFunctionNode = m_currfuncnode;
+                m_currfuncnode = n.get();
+
+                optimizeNode(n->body);
+
+                m_currfuncnode = oldFunctionNode;
+                break;
+            }
+
+            case ast::Node::N_FunctionCall:
+            {
+                auto n = std::dynamic_pointer_cast<ast::FunctionCallNode>(node);
+                optimizeNode(n->function);
+                optimizeNode(n->arguments);
+                break;
+            }
+
+            case ast::Node::N_Return:
+                optimizeNode(std::dynamic_pointer_cast<ast::ReturnNode>(node)->value);
+                break;
+
+            case ast::Node::N_Break:
+                optimizeNode(std::dynamic_pointer_cast<ast::BreakNode>(node)->value);
+                break;
+
+            case ast::Node::N_Continue:
+                optimizeNode(std::dynamic_pointer_cast<ast::ContinueNode>(node)->value);
+                break;
+
+            case ast::Node::N_Yield:
+                optimizeNode(std::dynamic_pointer_cast<ast::YieldNode>(node)->value);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    void Optimizer::optimizeBlock(const std::shared_ptr<ast::BlockNode>& n)
+    {
+        // A variable stored only once is known in the statements after its store, they
+        // run after it. The functions made there run after it too, so they see the globals.
+        std::vector<VariableKey> known;
+
+        for(auto& statement : n->nodes)
+        {
+            optimizeNode(statement);
+
+            if(statement->type != ast::Node::N_BinaryOperator)
+                continue;
+
+            auto assignment = std::dynamic_pointer_cast<ast::BinaryOperatorNode>(statement);
+            VariableKey key;
+
+            if(assignment->op == T_Assignment && isLiteral(assignment->rhs) && propagatedKey(assignment->lhs, &key)
+               && m_storescount[key] == 1)
+            {
+                m_constvars[key] = assignment->rhs;
+                known.push_back(key);
+            }
+        }
+
+        // the block may not run at all, past it nothing is known
+        for(auto& key : known)
+            m_constvars.erase(key);
+    }
+
+    std::shared_ptr<ast::Node> Optimizer::foldUnaryOperator(const std::shared_ptr<ast::UnaryOperatorNode>& n) const
+    {
+        const auto& operand = n->operand;
+
+        if(!isLiteral(operand))
+            return nullptr;
+
+        FoldedNumber number;
+        bool isNumber = literalNumber(operand, &number);
+
+        switch(n->op)
+        {
+            case T_Add:
+                return isNumber ? copyLiteral(operand, n->coords) : nullptr;
+
+            case T_Subtract:
+                if(!isNumber)
+                    return nullptr;
+                if(number.isFloat)
+                    return makeFloat(-number.floatingPoint, n->coords);
+                return makeInteger(-(long long)number.integer, n->coords);
+
+            case T_Not:
+                return std::make_shared<ast::BoolNode>(!literalAsBool(operand), n->coords);
+
+            case T_Concatenate:
+                return std::make_shared<ast::StringNode>(literalAsString(operand), n->coords);
+
+            case T_SizeOf:
+                if(operand->type != ast::Node::N_String)
+                    return nullptr;
+                return makeInteger((long long)std::dynamic_pointer_cast<ast::StringNode>(operand)->value.size(), n->coords);
+
+            default:
+                return nullptr;
+        }
+    }
+
+    std::shared_ptr<ast::Node> Optimizer::foldBinaryOperator(const std::shared_ptr<ast::BinaryOperatorNode>& n) const
+    {
+        const auto& lhs = n->lhs;
+        const auto& rhs = n->rhs;
+
+        if(!isLiteral(lhs) || !isLiteral(rhs))
+            return nullptr;
+
+        // the operators that take anything
+        switch(n->op)
+        {
+            case T_Concatenate:
+                return std::make_shared<ast::StringNode>(literalAsString(lhs) + literalAsString(rhs), n->coords);
+
+            case T_Xor:
+                return std::make_shared<ast::BoolNode>(literalAsBool(lhs) != literalAsBool(rhs), n->coords);
+
+            case T_Equal:
+            case T_NotEqual:
+            {
+                FoldedNumber a, b;
+                bool equal;
+
+                if(literalNumber(lhs, &a) && literalNumber(rhs, &b))
+                    equal = !a.isFloat && !b.isFloat ? a.integer == b.integer : a.asFloat() == b.asFloat();
+                else if(lhs->type != rhs->type)
+                    equal = false;
+                else if(lhs->type == ast::Node::N_Nil)
+                    equal = true;
+                else// booleans or strings
+                    equal = literalAsString(lhs) == literalAsString(rhs);
+
+                return std::make_shared<ast::BoolNode>(n->op == T_Equal ? equal : !equal, n->coords);
+            }
+
+            default:
+                break;
+        }
+
+        // the rest are the arithmetic and the comparisons of numbers
+        FoldedNumber a, b;
+
+        if(!literalNumber(lhs, &a) || !literalNumber(rhs, &b))
+            return nullptr;
+
+        bool isFloat = a.isFloat || b.isFloat;
+        long long x = a.integer;
+        long long y = b.integer;
+
+        switch(n->op)
+        {
+            case T_Add:
+                return isFloat ? makeFloat(a.asFloat() + b.asFloat(), n->coords) : makeInteger(x + y, n->coords);
+
+            case T_Subtract:
+                return isFloat ? makeFloat(a.asFloat() - b.asFloat(), n->coords) : makeInteger(x - y, n->coords);
+
+            case T_Multiply:
+                return isFloat ? makeFloat(a.asFloat() * b.asFloat(), n->coords) : makeInteger(x * y, n->coords);
+
+            case T_Divide:
+                if(b.asFloat() == 0)// the VM reports it
+                    return nullptr;
+                return isFloat ? makeFloat(a.asFloat() / b.asFloat(), n->coords) : makeInteger(x / y, n->coords);
+
+            case T_Power:
+            {
+                if(a.isFloat)
+                    return makeFloat(std::pow(a.asFloat(), b.asFloat()), n->coords);
+
+                double result = std::pow(a.integer, b.asFloat());
+
+                if(!(result >= INT_MIN && result <= INT_MAX))// the conversion to int would overflow
+                    return nullptr;
+
+                return makeInteger((long long)int(result), n->coords);
+            }
+
+            case T_Modulo:
+                if(isFloat)
+                    return makeFloat(std::fmod(a.asFloat(), b.asFloat()), n->coords);
+                if(y == 0 || (x == INT_MIN && y == -1))
+                    return nullptr;
+                return makeInteger(x % y, n->coords);
+
+            case T_Less:
+                return std::make_shared<ast::BoolNode>(isFloat ? a.asFloat() < b.asFloat() : x < y, n->coords);
+
+            case T_Greater:
+                return std::make_shared<ast::BoolNode>(isFloat ? a.asFloat() > b.asFloat() : x > y, n->coords);
+
+            case T_LessEqual:
+                return std::make_shared<ast::BoolNode>(isFloat ? a.asFloat() <= b.asFloat() : x <= y, n->coords);
+
+            case T_GreaterEqual:
+                return std::make_shared<ast::BoolNode>(isFloat ? a.asFloat() >= b.asFloat() : x >= y, n->coords);
+
+            default:
+                return nullptr;
+        }
+    }
+
+}// namespace element
@@ -276,7 +276,7 @@ namespace element
             }
             case T_Float:
             {
-                float f = m_lexer.getLastFloat();
+                double f = m_lexer.getLastFloat();
                 m_lexer.getNextToken();// eat float
                 return std::make_shared<ast::FloatNode>(f, coords);
             }
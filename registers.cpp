@@ -0,0 +1,258 @@
+#include "element.h"
+
+namespace element
+{
+    // the largest index each operand of a register instruction can hold
+    static const int MaxRegisterB = 255;
+    static const int MaxRegisterC = 65535;
+
+    // the first of the two register instructions for a binary operator, the second
+    // one takes a constant for C, or the operator itself if it has none
+    static OpCode registerOperation(OpCode opCode)
+    {
+        switch(opCode)
+        {
+            case OpCode::OC_Add:
+                return OpCode::OC_AddRegisters;
+            case OpCode::OC_Subtract:
+                return OpCode::OC_SubtractRegisters;
+            case OpCode::OC_Multiply:
+                return OpCode::OC_MultiplyRegisters;
+            case OpCode::OC_Divide:
+                return OpCode::OC_DivideRegisters;
+            case OpCode::OC_Equal:
+                return OpCode::OC_EqualRegistersJump;
+            case OpCode::OC_NotEqual:
+                return OpCode::OC_NotEqualRegistersJump;
+            case OpCode::OC_Less:
+                return OpCode::OC_LessRegistersJump;
+            case OpCode::OC_Greater:
+                return OpCode::OC_GreaterRegistersJump;
+            case OpCode::OC_LessEqual:
+                return OpCode::OC_LessEqualRegistersJump;
+            case OpCode::OC_GreaterEqual:
+                return OpCode::OC_GreaterEqualRegistersJump;
+            default:
+                return opCode;
+        }
+    }
+
+    // the instructions that can go on with a result kept aside in a register
+    static bool takesRegisters(OpCode opCode)
+    {
+        return opCode == OpCode::OC_LoadLocal || opCode == OpCode::OC_LoadConstant || opCode == OpCode::OC_StoreLocal
+               || opCode == OpCode::OC_PopStoreLocal || registerOperation(opCode) != opCode;
+    }
+
+    RegisterCompiler::RegisterCompiler() : m_firsttemp(0), m_tempscount(0)
+    {
+    }
+
+    void RegisterCompiler::pushPending()
+    {
+        for(const Operand& operand : m_pending)
+            m_translated.emplace_back(operand.constant ? OpCode::OC_LoadConstant : OpCode::OC_LoadLocal, operand.index);
+
+        m_pending.clear();
+    }
+
+    bool RegisterCompiler::pendingUses(int local) const
+    {
+        for(const Operand& operand : m_pending)
+            if(!operand.constant && operand.index == local)
+                return true;
+
+        return false;
+    }
+
+    // the temporaries are taken and given back in stack order, with the values kept aside
+    int RegisterCompiler::nextTemporary() const
+    {
+        int temp = m_firsttemp;
+
+        for(const Operand& operand : m_pending)
+            if(!operand.constant && operand.index >= m_firsttemp)
+                ++temp;
+
+        return temp;
+    }
+
+    void RegisterCompiler::compile(CodeObject* function)
+    {
+        const std::vector<Instruction>& instructions = function->instructions;
+        int instructionsCount = int(instructions.size());
+
+        std::vector<bool> jumpedTo(instructionsCount + 1, false);
+
+        for(int i = 0; i < instructionsCount; ++i)
+        {
+            if(isJump(instructions[i].opCode))
+                jumpedTo[instructions[i].A] = true;
+
+            // 'ForIter' skips the next 3 instructions, they have to stay where they are
+            if(instructions[i].opCode == OpCode::OC_ForIter)
+                for(int skipped = 1; skipped <= 4 && i + skipped <= instructionsCount; ++skipped)
+                    jumpedTo[i + skipped] = true;
+        }
+
+        m_pending.clear();
+        m_translated.clear();
+        m_firsttemp = function->localVariablesCount;
+        m_tempscount = 0;
+
+        std::vector<int> newIndices(instructionsCount + 1);
+
+        for(int i = 0; i < instructionsCount; ++i)
+        {
+            const Instruction& instruction = instructions[i];
+
+            // the jumps come with nothing kept aside
+            if(jumpedTo[i])
+                pushPending();
+
+            newIndices[i] = int(m_translated.size());
+
+            // the instruction after this one, if it can be translated together with it
+            const Instruction* next = i + 1 < instructionsCount && !jumpedTo[i + 1] ? &instructions[i + 1] : nullptr;
+
+            switch(instruction.opCode)
+            {
+                case OpCode::OC_LoadLocal:
+                case OpCode::OC_LoadConstant:
+                    if(instruction.A > MaxRegisterC)
+                        break;
+
+                    m_pending.push_back({ instruction.A, instruction.opCode == OpCode::OC_LoadConstant });
+                    continue;
+
+                case OpCode::OC_StoreLocal:
+                case OpCode::OC_PopStoreLocal:
+                {
+                    if(m_pending.empty() || instruction.A > MaxRegisterC)
+                        break;
+
+                    Operand value = m_pending.back();
+                    m_pending.pop_back();
+
+                    if(pendingUses(instruction.A))// a value kept aside would change
+                    {
+                        m_pending.push_back(value);
+                        break;
+                    }
+
+                    // a result just put in a temporary goes to the variable instead
+                    Instruction* last = m_translated.empty() ? nullptr : &m_translated.back();
+
+                    if(!value.constant && value.index >= m_firsttemp && last && last->A == value.index
+                       && last->opCode >= OpCode::OC_AddRegisters && last->opCode <= OpCode::OC_DivideRegisterConstant)
+                        last->A = instruction.A;
+                    else
+                        m_translated.emplace_back(value.constant ? OpCode::OC_MoveConstant : OpCode::OC_MoveRegister, instruction.A, 0, value.index);
+
+                    if(instruction.opCode == OpCode::OC_StoreLocal)// the value stays, now in the variable
+                        m_pending.push_back({ instruction.A, false });
+                    continue;
+                }
+
+                case OpCode::OC_Add:
+                case OpCode::OC_Subtract:
+                case OpCode::OC_Multiply:
+                case OpCode::OC_Divide:
+                case OpCode::OC_Equal:
+                case OpCode::OC_NotEqual:
+                case OpCode::OC_Less:
+                case OpCode::OC_Greater:
+                case OpCode::OC_LessEqual:
+                case OpCode::OC_GreaterEqual:
+                {
+                    if(m_pending.size() < 2)
+                        break;
+
+                    Operand lhs = m_pending[m_pending.size() - 2];
+                    Operand rhs = m_pending.back();
+
+                    if(lhs.constant || lhs.index > MaxRegisterB)
+                        break;
+
+                    OpCode registers = registerOperation(instruction.opCode);
+                    OpCode opCode = OpCode(registers + (rhs.constant ? 1 : 0));
+                    bool test = isJump(registers);
+
+                    if(test && (!next || next->opCode != OpCode::OC_PopJumpIfFalse))// a comparison only tests a jump
+                        break;
+
+                    if(!test && (!next || !takesRegisters(next->opCode)))// a result that would only be pushed
+                        break;
+
+                    m_pending.pop_back();
+                    m_pending.pop_back();
+
+                    if(test)
+                    {
+                        m_translated.emplace_back(opCode, next->A, lhs.index, rhs.index);
+                        newIndices[i + 1] = newIndices[i];
+                        ++i;
+                        continue;
+                    }
+
+                    // the result goes straight to the variable it is stored to
+                    if(next && next->opCode == OpCode::OC_PopStoreLocal && !pendingUses(next->A))
+                    {
+                        m_translated.emplace_back(opCode, next->A, lhs.index, rhs.index);
+                        newIndices[i + 1] = newIndices[i];
+                        ++i;
+                        continue;
+                    }
+
+                    int temp = nextTemporary();
+
+                    if(temp > MaxRegisterC)
+                    {
+                        m_pending.push_back(lhs);
+                        m_pending.push_back(rhs);
+                        break;
+                    }
+
+                    m_tempscount = std::max(m_tempscount, temp - m_firsttemp + 1);
+                    m_translated.emplace_back(opCode, temp, lhs.index, rhs.index);
+                    m_pending.push_back({ temp, false });
+                    continue;
+                }
+
+                default:
+                    break;
+            }
+
+            pushPending();
+            m_translated.push_back(instruction);
+        }
+
+        pushPending();
+
+        newIndices[instructionsCount] = int(m_translated.size());
+
+        for(Instruction& instruction : m_translated)
+            if(isJump(instruction.opCode))
+                instruction.A = newIndices[instruction.A];
+
+        std::vector<SourceCodeLine> lines;
+
+        for(SourceCodeLine line : function->instructionLines)
+        {
+            line.instructionIndex = newIndices[line.instructionIndex];
+
+            if(!lines.empty() && lines.back().instructionIndex == line.instructionIndex)
+                lines.pop_back();
+
+            if(lines.empty() || lines.back().line != line.line)
+                lines.push_back(line);
+        }
+
+        function->instructions = std::move(m_translated);
+        function->instructionLines = std::move(lines);
+        function->localVariablesCount += m_tempscount;
+
+        m_translated.clear();
+    }
+
+}// namespace element
@@ -539,7 +539,8 @@ namespace element
                 case ast::Node::N_BinaryOperator:
                 {
                     auto n = std::dynamic_pointer_cast<ast::BinaryOperatorNode>(node);
-                    nodesToProcess.push_back(n->rhs);
+                    if(n->op != Token::T_Dot)// the member name is not a variable
+                        nodesToProcess.push_back(n->rhs);
                     nodesToProcess.push_back(n->lhs);
                     break;
                 }
@@ -583,10 +584,7 @@ namespace element
                 {
                     auto n = std::dynamic_pointer_cast<ast::ObjectNode>(node);
                     for(auto it = n->members.rbegin(); it != n->members.rend(); ++it)
-                    {
-                        nodesToProcess.push_back(it->second);
-                        nodesToProcess.push_back(it->first);
-                    }
+                        nodesToProcess.push_back(it->second);// the keys are member names, not variables
                     break;
                 }
 
@@ -1,8 +1,13 @@
 @echo off
 
 set interpreter=..\bin\element_d.exe
+if not "%~1"=="" set interpreter=%~1
+set options=%~2
 
-for %%f in (*.element) do (
-	echo tests from: %%f
-	%interpreter% --test %%f
+rem the tests run on the stack instructions and then on the register ones
+for %%b in ("" "-r") do (
+	for %%f in (*.element) do (
+		echo tests from: %%f %options% %%~b
+		%interpreter% %options% %%~b --test %%f
+	)
 )
@@ -1,7 +1,15 @@
-interpreter=../bin/element_d
+# Runs the test files on the stack instructions and then on the register ones.
+# usage: ./run-all-tests.sh [interpreter] [options]
+# the options go to the interpreter in both runs, like -O0 to turn off the optimizations
 
-for file in $(ls *.element)
+interpreter=${1:-../bin/element_d}
+options=${2:-}
+
+for backend in "" "-r"
 do
-	echo tests from: $file
-	$interpreter --test $file
+	for file in $(ls *.element)
+	do
+		echo tests from: $file $options $backend
+		$interpreter $options $backend --test $file
+	done
 done
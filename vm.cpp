@@ -5,18 +5,52 @@
 #include <fstream>
 #include "element.h"
 
+// Threaded dispatch jumps from the end of every opcode handler straight to the
+// handler of the next instruction through the table that each code object decodes
+// when it first runs. It relies on the "labels as values" extension, define
+// ELEMENT_SWITCH_DISPATCH to build the portable switch based loop instead.
+// VM_REWRITE replaces the opcode of the current instruction while running.
+#if defined(__GNUC__) && !defined(ELEMENT_SWITCH_DISPATCH)
+    #define ELEMENT_THREADED_DISPATCH 1
+    #define VM_SWITCH(opCode)
+    #define VM_CASE(opCode) L_##opCode
+    #define VM_DEFAULT L_InvalidOpCode
+    #define VM_DISPATCH() goto *handlers[frame->ip - frame->instructions]
+    #define VM_REWRITE(newOpCode) (const_cast<Instruction*>(frame->ip)->opCode = (newOpCode), \
+                                   handlers[frame->ip - frame->instructions] = opCodeHandlers[(newOpCode)])
+#else
+    #define ELEMENT_THREADED_DISPATCH 0
+    #define VM_SWITCH(opCode) switch(opCode)
+    #define VM_CASE(opCode) case opCode
+    #define VM_DEFAULT default
+    #define VM_DISPATCH() break
+    #define VM_REWRITE(newOpCode) (const_cast<Instruction*>(frame->ip)->opCode = (newOpCode))
+#endif
+
+// frameRunCode keeps the top of the value stack in 'sp', it has to be written back
+// before anything that can look at the stack, like the GC, and read again after it
+#define VM_SYNC() (m_stack->top = sp)
+#define VM_RELOAD() (sp = m_stack->top)
+#define VM_EXIT() do { VM_SYNC(); return; } while(false)
+
+// the collector runs a bounded step at jumps and calls once allocations have run up its debt
+#define VM_SAFEPOINT() do { if(m_memoryman.collectionDue()) { VM_SYNC(); m_memoryman.stepGarbageCollection(); } } while(false)
+
 namespace element
 {
-    VirtualMachine::VirtualMachine():
+    VirtualMachine::VirtualMachine(int markThreads):
         m_logger(),
         m_parser(m_logger),
         m_analyzer(m_logger),
         m_compiler(m_logger),
         m_fileman(),
-        m_memoryman(),
+        m_memoryman(markThreads),
         m_execctx(nullptr),
-        m_stack(nullptr)
+        m_stack(nullptr),
+        m_optlevel(1)
     {
+        m_memoryman.setRunningContext(&m_execctx);
+
         registerBuiltins();
         {
             std::stringstream tmp;
@@ -43,6 +77,7 @@ namespace element
         m_constants.clear();
 
         m_natfuncs.clear();
+        m_natives.clear();
         m_symnames.clear();
 
         m_execctx = nullptr;
@@ -59,6 +94,44 @@ namespace element
         m_analyzer.addGlobal(name, v);
     }
 
+    Value VirtualMachine::inlineCacheStats()
+    {
+        Array* result = m_memoryman.makeArray();
+
+        for(const CodeObject& codeObject : m_constcodeobjects)
+        {
+            for(const InlineCache& cache : codeObject.inlineCaches)
+            {
+                int line = 0;
+
+                for(const SourceCodeLine& sourceLine : codeObject.instructionLines)
+                {
+                    if(sourceLine.instructionIndex > int(cache.instructionIndex))
+                        break;
+
+                    line = sourceLine.line;
+                }
+
+                std::string member;
+                nameFromHash(cache.hash, &member);
+
+                Value data = m_memoryman.makeObject();
+
+                setMember(data, "file", m_memoryman.makeString(codeObject.module ? codeObject.module->filename : ""));
+                setMember(data, "line", Value(line));
+                setMember(data, "member", m_memoryman.makeString(member));
+                setMember(data, "kind", m_memoryman.makeString(cache.kind == InlineCache::IC_Load ? "load" : "store"));
+                setMember(data, "state", m_memoryman.makeString(cache.stateName()));
+                setMember(data, "hits", Value(int(cache.hits)));
+                setMember(data, "misses", Value(int(cache.misses)));
+
+                arrayPushElement(result, data);
+            }
+        }
+
+        return result;
+    }
+
     Value VirtualMachine::evalStream(std::istream& input)
     {
         Value result;
@@ -72,6 +145,9 @@ namespace element
 
             if(!m_logger.hasMessages())
             {
+                if(m_optlevel > 0)
+                    m_optimizer.optimize(shptr);
+
                 std::unique_ptr<char[]> bytecode = m_compiler.compile(shptr);
 
                 if(!m_logger.hasMessages())
@@ -120,6 +196,9 @@ namespace element
 
             if(!m_logger.hasMessages())
             {
+                if(m_optlevel > 0)
+                    m_optimizer.optimize(node);
+
                 bytecode = m_compiler.compile(node);
 
                 if(!m_logger.hasMessages())
@@ -174,7 +253,20 @@ namespace element
     {
         int index = int(m_natfuncs.size());
 
-        m_natfuncs.push_back(function);
+        m_natives.emplace_back();
+        m_natives.back().function = function;
+        m_natfuncs.emplace_back(&m_natives.back());
+
+        m_analyzer.addNative(name, index);
+    }
+
+    void VirtualMachine::addNative(const std::string& name, Value::VectorNativeFunction function)
+    {
+        int index = int(m_natfuncs.size());
+
+        m_natives.emplace_back();
+        m_natives.back().vectorFunction = function;
+        m_natfuncs.emplace_back(&m_natives.back());
 
         m_analyzer.addNative(name, index);
     }
@@ -184,36 +276,48 @@ namespace element
         return "element interpreter version 0.0.5";
     }
 
+    // 0 compiles the code as it is written, 1 folds the constants and rewrites the instructions
+    void VirtualMachine::setOptimizationLevel(int level)
+    {
+        m_optlevel = level;
+        m_compiler.setOptimizationLevel(level);
+    }
+
+    void VirtualMachine::setBackend(Compiler::Backend backend)
+    {
+        m_compiler.setBackend(backend);
+    }
+
     Iterator* VirtualMachine::makeIterator(const Value& value)
     {
-        switch(value.type)
+        switch(value.type())
         {
             case Value::VT_Iterator:
-                return value.iterator;
+                return value.iterator();
 
             case Value::VT_Array:
-                return m_memoryman.makeIterator(new ArrayIterator(value.array));
+                return m_memoryman.makeIterator<ArrayIterator>(value.array());
 
             case Value::VT_String:
-                return m_memoryman.makeIterator(new StringIterator(value.string));
+                return m_memoryman.makeIterator<StringIterator>(value.string());
 
             case Value::VT_Object:
             {
                 Value hasNextMemberFunction;
-                loadMemberFromObject(value.object, Symbol::HasNextHash, &hasNextMemberFunction);
+                loadMemberFromObject(value.object(), Symbol::HasNextHash, &hasNextMemberFunction);
 
                 Value getNextMemberFunction;
-                loadMemberFromObject(value.object, Symbol::GetNextHash, &getNextMemberFunction);
+                loadMemberFromObject(value.object(), Symbol::GetNextHash, &getNextMemberFunction);
 
                 if(hasNextMemberFunction.isNil() || getNextMemberFunction.isNil())
                     return nullptr;
 
-                return m_memoryman.makeIterator(new ObjectIterator(value, hasNextMemberFunction, getNextMemberFunction));
+                return m_memoryman.makeIterator<ObjectIterator>(value, hasNextMemberFunction, getNextMemberFunction);
             }
 
             case Value::VT_Function:
-                if(value.function->executionContext)// only coroutines
-                    return m_memoryman.makeIterator(new CoroutineIterator(value.function));
+                if(value.function()->executionContext)// only coroutines
+                    return m_memoryman.makeIterator<CoroutineIterator>(value.function());
 
             default:
                 return nullptr;
@@ -260,57 +364,57 @@ namespace element
     Value VirtualMachine::getMember(const Value& object, const std::string& memberName)
     {
         Value result;
-        loadMemberFromObject(object.object, hashFromName(memberName), &result);
+        loadMemberFromObject(object.object(), hashFromName(memberName), &result);
         return result;
     }
 
     Value VirtualMachine::getMember(const Value& object, unsigned memberHash) const
     {
         Value result;
-        loadMemberFromObject(object.object, memberHash, &result);
+        loadMemberFromObject(object.object(), memberHash, &result);
         return result;
     }
 
     void VirtualMachine::setMember(const Value& object, const std::string& memberName, const Value& value)
     {
-        objectStoreMember(object.object, hashFromName(memberName), value);
+        objectStoreMember(object.object(), hashFromName(memberName), value);
     }
 
     void VirtualMachine::setMember(const Value& object, unsigned memberHash, const Value& value)
     {
-        objectStoreMember(object.object, memberHash, value);
+        objectStoreMember(object.object(), memberHash, value);
     }
 
     void VirtualMachine::pushElement(const Value& array, const Value& value)
     {
-        arrayPushElement(array.array, value);
+        arrayPushElement(array.array(), value);
     }
 
     void VirtualMachine::addElement(const Value& array, int atIndex, const Value& value)
     {
-        arrayStoreElement(array.array, atIndex, value);
+        arrayStoreElement(array.array(), atIndex, value);
     }
 
-    Value VirtualMachine::callFunction(const Value& function, const std::vector<Value>& args)
+    Value VirtualMachine::callFunction(const Value& function, Arguments args)
     {
         return commonCallFunction(Value(), function, args);
     }
 
-    Value VirtualMachine::callMemberFunction(const Value& object, const std::string& memberFunctionName, const std::vector<Value>& args)
+    Value VirtualMachine::callMemberFunction(const Value& object, const std::string& memberFunctionName, Arguments args)
     {
         Value memberFunction = getMember(object, memberFunctionName);
 
         return commonCallFunction(object, memberFunction, args);
     }
 
-    Value VirtualMachine::callMemberFunction(const Value& object, unsigned functionHash, const std::vector<Value>& args)
+    Value VirtualMachine::callMemberFunction(const Value& object, unsigned functionHash, Arguments args)
     {
         Value memberFunction = getMember(object, functionHash);
 
         return commonCallFunction(object, memberFunction, args);
     }
 
-    Value VirtualMachine::callMemberFunction(const Value& object, const Value& function, const std::vector<Value>& args)
+    Value VirtualMachine::callMemberFunction(const Value& object, const Value& function, Arguments args)
     {
         return commonCallFunction(object, function, args);
     }
@@ -319,14 +423,12 @@ namespace element
     {
         int firstFunctionConstantIndex = parseBytecode(bytecode, forModule);
 
-        Function* main = m_constants[firstFunctionConstantIndex].function;
-
-        ExecutionContext dummyContext;
+        Function* main = m_constants[firstFunctionConstantIndex].function();
 
         if(!m_execctx)// first run
         {
-            m_execctx = &dummyContext;
-            m_stack = &dummyContext.stack;
+            m_execctx = &m_basectx;
+            m_stack = &m_basectx.stack;
         }
 
         return commonCallFunction(Value(), main, {});
@@ -402,6 +504,7 @@ namespace element
                     m_conststrings.emplace_back(std::move(*(currentConstant.string)));
 
                     m_conststrings.back().state = GarbageCollected::GC_Static;
+                    m_conststrings.back().flags = GarbageCollected::GCF_Static;
 
                     m_constants.emplace_back(&m_conststrings.back());
                     break;
@@ -415,8 +518,30 @@ namespace element
 
                     codeObject->module = &forModule;
 
+                    // give every member access its own inline cache
+                    for(unsigned i = 0; i < codeObject->instructions.size(); ++i)
+                    {
+                        Instruction& instruction = codeObject->instructions[i];
+
+                        if(instruction.opCode != OpCode::OC_LoadMember && instruction.opCode != OpCode::OC_StoreMember &&
+                           instruction.opCode != OpCode::OC_PopStoreMember)
+                        {
+                            continue;
+                        }
+
+                        InlineCache::Kind kind = instruction.opCode == OpCode::OC_LoadMember ? InlineCache::IC_Load : InlineCache::IC_Store;
+                        instruction.A = int(codeObject->inlineCaches.size());
+                        codeObject->inlineCaches.emplace_back(kind, i);
+
+                        // the member hash is normally loaded right before
+                        if(i > 0 && (codeObject->instructions[i - 1].opCode == OpCode::OC_LoadHash ||
+                                     codeObject->instructions[i - 1].opCode == OpCode::OC_LoadHashMember))
+                            codeObject->inlineCaches.back().hash = codeObject->instructions[i - 1].H;
+                    }
+
                     m_constfunctions.emplace_back(codeObject);
                     m_constfunctions.back().state = GarbageCollected::GC_Static;
+                    m_constfunctions.back().flags = GarbageCollected::GCF_Static;
 
                     if(firstFunctionConstantIndex == -1)
                         firstFunctionConstantIndex = int(m_constants.size());
@@ -434,22 +559,26 @@ namespace element
         return firstFunctionConstantIndex;
     }
 
-    Value VirtualMachine::commonCallFunction(const Value& thisObject, const Value& function, const std::vector<Value>& args)
+    Value VirtualMachine::commonCallFunction(const Value& thisObject, const Value& function, Arguments args)
     {
-        if(function.type == Value::VT_NativeFunction)
+        if(function.type() == Value::VT_NativeFunction)
         {
-            return function.nativeFunction(*this, thisObject, args);
+            return function.native()->call(*this, thisObject, args);
         }
         else// normal function
         {
             // switch context
             ExecutionContext* oldContext = m_execctx;
             m_execctx = m_memoryman.makeRootExecutionContext();
+            m_execctx->caller = oldContext;
             m_stack = &m_execctx->stack;
 
-            m_stack->reserve(args.size());
-            std::copy(args.begin(), args.end(), std::back_inserter(*m_stack));
-            m_stack->push_back(function);
+            m_stack->reserve(unsigned(args.size()) + 1);
+
+            for(const Value& argument : args)
+                m_stack->push(argument);
+
+            m_stack->push(function);
 
             m_execctx->lastObject = thisObject;
 
@@ -467,18 +596,15 @@ namespace element
 
     Value VirtualMachine::runCode()
     {
-        StackFrame* frame = nullptr;
-
-        // IMPORTANT: the current 'm_execctx' may change during 'frameRunCode'
+        // calls and returns stay inside 'frameRunCode', it only comes back here
+        // when switching to or from a coroutine, which changes 'm_execctx'
         while(!m_execctx->stackFrames.empty())
         {
-            frame = &m_execctx->stackFrames.back();
-
-            frameRunCode(frame);
+            frameRunCode(&m_execctx->stackFrames.back());
 
             if(hasError())
             {
-                logStacktraceFrom(frame);
+                logStacktraceFrom(&m_execctx->stackFrames.back());
 
                 return m_memoryman.makeError("runtime-error");
             }
@@ -490,597 +616,913 @@ namespace element
         if(!m_stack->empty())
         {
             result = m_stack->back();
-            m_stack->pop_back();
+            m_stack->pop();
         }
 
         return result;
     }
 
+    // The form of a generic binary operation specialized for the given operand
+    // types, or the operation itself if it has none
+    static OpCode specializedBinaryOperation(OpCode opCode, const Value& lhs, const Value& rhs)
+    {
+        bool ints = lhs.isInt() && rhs.isInt();
+        bool floats = lhs.isFloat() && rhs.isFloat();
+
+        switch(opCode)
+        {
+            case OpCode::OC_Add:
+                return ints ? OC_AddIntInt : floats ? OC_AddFloatFloat : opCode;
+            case OpCode::OC_Subtract:
+                return ints ? OC_SubtractIntInt : floats ? OC_SubtractFloatFloat : opCode;
+            case OpCode::OC_Multiply:
+                return ints ? OC_MultiplyIntInt : floats ? OC_MultiplyFloatFloat : opCode;
+            case OpCode::OC_Divide:
+                return ints ? OC_DivideIntInt : floats ? OC_DivideFloatFloat : opCode;
+            case OpCode::OC_Modulo:
+                return ints ? OC_ModuloIntInt : opCode;
+            case OpCode::OC_Concatenate:
+                return lhs.isString() && rhs.isString() ? OC_ConcatenateStrStr : opCode;
+            case OpCode::OC_Equal:
+                return ints ? OC_EqualIntInt : opCode;
+            case OpCode::OC_NotEqual:
+                return ints ? OC_NotEqualIntInt : opCode;
+            case OpCode::OC_Less:
+                return ints ? OC_LessIntInt : floats ? OC_LessFloatFloat : opCode;
+            case OpCode::OC_Greater:
+                return ints ? OC_GreaterIntInt : floats ? OC_GreaterFloatFloat : opCode;
+            case OpCode::OC_LessEqual:
+                return ints ? OC_LessEqualIntInt : floats ? OC_LessEqualFloatFloat : opCode;
+            case OpCode::OC_GreaterEqual:
+                return ints ? OC_GreaterEqualIntInt : floats ? OC_GreaterEqualFloatFloat : opCode;
+            default:
+                return opCode;
+        }
+    }
+
+    // The generic binary operation a specialized one was made from
+    static OpCode genericBinaryOperation(OpCode opCode)
+    {
+        switch(opCode)
+        {
+            case OpCode::OC_AddIntInt:
+            case OpCode::OC_AddFloatFloat:
+                return OC_Add;
+            case OpCode::OC_SubtractIntInt:
+            case OpCode::OC_SubtractFloatFloat:
+                return OC_Subtract;
+            case OpCode::OC_MultiplyIntInt:
+            case OpCode::OC_MultiplyFloatFloat:
+                return OC_Multiply;
+            case OpCode::OC_DivideIntInt:
+            case OpCode::OC_DivideFloatFloat:
+                return OC_Divide;
+            case OpCode::OC_ModuloIntInt:
+                return OC_Modulo;
+            case OpCode::OC_ConcatenateStrStr:
+                return OC_Concatenate;
+            case OpCode::OC_EqualIntInt:
+                return OC_Equal;
+            case OpCode::OC_NotEqualIntInt:
+                return OC_NotEqual;
+            case OpCode::OC_LessIntInt:
+            case OpCode::OC_LessFloatFloat:
+                return OC_Less;
+            case OpCode::OC_GreaterIntInt:
+            case OpCode::OC_GreaterFloatFloat:
+                return OC_Greater;
+            case OpCode::OC_LessEqualIntInt:
+            case OpCode::OC_LessEqualFloatFloat:
+                return OC_LessEqual;
+            case OpCode::OC_GreaterEqualIntInt:
+            case OpCode::OC_GreaterEqualFloatFloat:
+                return OC_GreaterEqual;
+            default:
+                return opCode;
+        }
+    }
+
     void VirtualMachine::frameRunCode(StackFrame* frame)
     {
+        const CodeObject* codeObject = nullptr;
+        InlineCache* inlineCaches = nullptr;
+        Value* locals = nullptr;
+        Value* sp = m_stack->top;
+        const Value* registerC = nullptr;// the C operand of the register instruction running
+        OpCode registerOperator = OC_Add;// the operator it falls back to
+
+    #if ELEMENT_THREADED_DISPATCH
+        // the order must match the OpCode enum
+        static const void* const opCodeHandlers[] =
+        {
+            &&L_OC_Pop, &&L_OC_PopN, &&L_OC_Rotate2, &&L_OC_MoveToTOSN, &&L_OC_Duplicate, &&L_OC_Unpack,
+            &&L_OC_LoadConstant, &&L_OC_LoadLocal, &&L_OC_LoadGlobal, &&L_OC_LoadNative, &&L_OC_LoadArgument,
+            &&L_OC_LoadArgsArray, &&L_OC_LoadThis, &&L_OC_StoreLocal, &&L_OC_StoreGlobal, &&L_OC_PopStoreLocal,
+            &&L_OC_PopStoreGlobal, &&L_OC_MakeArray, &&L_OC_LoadElement, &&L_OC_StoreElement, &&L_OC_PopStoreElement,
+            &&L_OC_ArrayPushBack, &&L_OC_ArrayPopBack, &&L_OC_MakeObject, &&L_OC_MakeEmptyObject, &&L_OC_LoadHash,
+            &&L_OC_LoadMember, &&L_OC_StoreMember, &&L_OC_PopStoreMember, &&L_OC_MakeIterator, &&L_OC_ForIter, &&L_OC_MakeRange, &&L_OC_ForRange, &&L_OC_IteratorHasNext,
+            &&L_OC_IteratorGetNext, &&L_OC_MakeBox, &&L_OC_LoadFromBox, &&L_OC_StoreToBox, &&L_OC_PopStoreToBox,
+            &&L_OC_MakeClosure, &&L_OC_LoadFromClosure, &&L_OC_StoreToClosure, &&L_OC_PopStoreToClosure, &&L_OC_Jump,
+            &&L_OC_JumpIfFalse, &&L_OC_PopJumpIfFalse, &&L_OC_JumpIfFalseOrPop, &&L_OC_JumpIfTrueOrPop,
+            &&L_OC_FunctionCall, &&L_OC_Yield, &&L_OC_EndFunction, &&L_OC_Add, &&L_OC_Subtract, &&L_OC_Multiply,
+            &&L_OC_Divide, &&L_OC_Power, &&L_OC_Modulo, &&L_OC_Concatenate, &&L_OC_Xor, &&L_OC_Equal, &&L_OC_NotEqual,
+            &&L_OC_Less, &&L_OC_Greater, &&L_OC_LessEqual, &&L_OC_GreaterEqual, &&L_OC_UnaryPlus, &&L_OC_UnaryMinus,
+            &&L_OC_UnaryNot, &&L_OC_UnaryConcatenate, &&L_OC_UnarySizeOf, &&L_OC_AddIntInt, &&L_OC_AddFloatFloat,
+            &&L_OC_SubtractIntInt, &&L_OC_SubtractFloatFloat, &&L_OC_MultiplyIntInt, &&L_OC_MultiplyFloatFloat,
+            &&L_OC_DivideIntInt, &&L_OC_DivideFloatFloat, &&L_OC_ModuloIntInt, &&L_OC_ConcatenateStrStr,
+            &&L_OC_EqualIntInt, &&L_OC_NotEqualIntInt, &&L_OC_LessIntInt, &&L_OC_LessFloatFloat,
+            &&L_OC_GreaterIntInt, &&L_OC_GreaterFloatFloat, &&L_OC_LessEqualIntInt, &&L_OC_LessEqualFloatFloat,
+            &&L_OC_GreaterEqualIntInt, &&L_OC_GreaterEqualFloatFloat, &&L_OC_LoadLocalLocal, &&L_OC_LoadGlobalGlobal,
+            &&L_OC_LoadLocalConstant, &&L_OC_AddLocalLocal, &&L_OC_AddLocalConstantStore, &&L_OC_LessLocalConstantJump,
+            &&L_OC_LoadHashMember, &&L_OC_MoveRegister, &&L_OC_MoveConstant, &&L_OC_AddRegisters,
+            &&L_OC_AddRegisterConstant, &&L_OC_SubtractRegisters, &&L_OC_SubtractRegisterConstant,
+            &&L_OC_MultiplyRegisters, &&L_OC_MultiplyRegisterConstant, &&L_OC_DivideRegisters,
+            &&L_OC_DivideRegisterConstant, &&L_OC_EqualRegistersJump,
+            &&L_OC_EqualRegisterConstantJump, &&L_OC_NotEqualRegistersJump, &&L_OC_NotEqualRegisterConstantJump,
+            &&L_OC_LessRegistersJump, &&L_OC_LessRegisterConstantJump, &&L_OC_GreaterRegistersJump,
+            &&L_OC_GreaterRegisterConstantJump, &&L_OC_LessEqualRegistersJump, &&L_OC_LessEqualRegisterConstantJump,
+            &&L_OC_GreaterEqualRegistersJump, &&L_OC_GreaterEqualRegisterConstantJump,
+        };
+
+        static_assert(sizeof(opCodeHandlers) / sizeof(opCodeHandlers[0]) == OC_OpCodesCount,
+                      "opCodeHandlers is out of sync with the OpCode enum");
+
+        const void** handlers = nullptr;
+    #endif
+
+    enterFrame:// calls and returns between script functions switch the frame here
+        VM_SAFEPOINT();
+
+        codeObject = frame->function->codeObject;
+        inlineCaches = codeObject->inlineCaches.data();
+
+        // the stack has room for all the operands of the frame, it can only move
+        // when a new frame is pushed and then this is read again
+        locals = m_stack->bottom() + frame->base;
+
+    #if ELEMENT_THREADED_DISPATCH
+        // decode the handlers of a code object the first time it runs
+        if(codeObject->handlers.size() != codeObject->instructions.size())
+        {
+            codeObject->handlers.resize(codeObject->instructions.size());
+
+            for(size_t i = 0; i < codeObject->instructions.size(); ++i)
+            {
+                unsigned char opCode = (unsigned char)codeObject->instructions[i].opCode;
+
+                codeObject->handlers[i] = opCode < OC_OpCodesCount ? opCodeHandlers[opCode] : &&L_InvalidOpCode;
+            }
+        }
+
+        handlers = codeObject->handlers.data();
+
+        VM_DISPATCH();
+    #endif
+
         while(true)
         {
-            switch(frame->ip->opCode)
+            VM_SWITCH(frame->ip->opCode)
             {
-                case OC_Pop:// pop TOS
-                    m_stack->pop_back();
+                VM_CASE(OC_Pop):// pop TOS
+                    --sp;
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
 
-                case OC_PopN:// pop A values from the stack
-                    for(int i = frame->ip->A; i > 0; --i)
-                        m_stack->pop_back();
+                VM_CASE(OC_PopN):// pop A values from the stack
+                    sp -= frame->ip->A;
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
 
-                case OC_Rotate2:// swap TOS and TOS1
-                {
-                    int tos = int(m_stack->size()) - 1;
-                    Value value = m_stack->at(tos - 1);
-                    m_stack->at(tos - 1) = m_stack->at(tos);
-                    m_stack->at(tos) = value;
+                VM_CASE(OC_Rotate2):// swap TOS and TOS1
+                    std::swap(sp[-2], sp[-1]);
                     ++frame->ip;
-                    break;
-                }
+                    VM_DISPATCH();
 
-                case OC_MoveToTOS2:// copy TOS over TOS2 and pop TOS
-                {
-                    int tos = int(m_stack->size()) - 1;
-                    m_stack->at(tos - 2) = m_stack->at(tos);
-                    m_stack->pop_back();
+                VM_CASE(OC_MoveToTOSN):// copy TOS over the value A places beneath it and pop TOS
+                    sp[-1 - frame->ip->A] = sp[-1];
+                    --sp;
                     ++frame->ip;
-                    break;
-                }
+                    VM_DISPATCH();
 
-                case OC_Duplicate:// make a copy of TOS and push it to the stack
-                {
-                    m_stack->push_back(m_stack->back());
+                VM_CASE(OC_Duplicate):// make a copy of TOS and push it to the stack
+                    sp[0] = sp[-1];
+                    ++sp;
                     ++frame->ip;
-                    break;
-                }
+                    VM_DISPATCH();
 
-                case OC_Unpack:// A is the number of values to be produced from the TOS value
+                VM_CASE(OC_Unpack):// A is the number of values to be produced from the TOS value
                 {
-                    Value valueToUnpack = m_stack->back();
-                    m_stack->pop_back();
+                    Value valueToUnpack = sp[-1];
+                    --sp;
 
                     int expectedSize = frame->ip->A;
 
                     if(valueToUnpack.isArray())
                     {
-                        const std::vector<Value>& elements = valueToUnpack.array->elements;
+                        const std::vector<Value>& elements = valueToUnpack.array()->elements;
                         int arraySize = int(elements.size());
 
                         if(arraySize >= expectedSize)
                         {
                             for(int i = expectedSize - 1; i >= 0; --i)
-                                m_stack->push_back(elements[i]);
+                                *sp++ = elements[i];
                         }
                         else// arraySize < expectedSize
                         {
                             for(int i = expectedSize - arraySize; i > 0; --i)
-                                m_stack->emplace_back();// nil
+                                *sp++ = Value();// nil
 
                             for(int i = arraySize - 1; i >= 0; --i)
-                                m_stack->push_back(elements[i]);
+                                *sp++ = elements[i];
                         }
                     }
                     else
                     {
                         for(int i = expectedSize - 1; i > 0; --i)
-                            m_stack->emplace_back();// nil
+                            *sp++ = Value();// nil
 
-                        m_stack->push_back(valueToUnpack);
+                        *sp++ = valueToUnpack;
                     }
 
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_LoadConstant:// A is the index in the constants vector
-                    m_stack->push_back(m_constants[frame->ip->A]);
+                VM_CASE(OC_LoadConstant):// A is the index in the constants vector
+                    *sp++ = m_constants[frame->ip->A];
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
 
-                case OC_LoadLocal:// A is the index in the function scope
-                    m_stack->push_back(frame->variables[frame->ip->A]);
+                VM_CASE(OC_LoadLocal):// A is the index in the function scope
+                    *sp++ = locals[frame->ip->A];
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
 
-                case OC_LoadGlobal:// A is the index in the global scope
+                VM_CASE(OC_LoadGlobal):// A is the index in the global scope
                 {
                     unsigned index = unsigned(frame->ip->A);
-                    m_stack->push_back(index < frame->globals->size() ? frame->globals->at(index) : Value());
+                    *sp++ = index < frame->globals->size() ? frame->globals->at(index) : Value();
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_LoadNative:// A is the index in the native functions
-                    m_stack->push_back(m_natfuncs[frame->ip->A]);
+                VM_CASE(OC_LoadNative):// A is the index in the native functions
+                    *sp++ = m_natfuncs[frame->ip->A];
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
 
-                case OC_LoadArgument:// A is the index in the arguments array
-                    if(int(frame->anonymousParameters.elements.size()) > frame->ip->A)
-                        m_stack->push_back(frame->anonymousParameters.elements[frame->ip->A]);
+                VM_CASE(OC_LoadArgument):// A is the index in the arguments array
+                    if(frame->anonymousParameters)// the $$ array may have been changed
+                    {
+                        if(int(frame->anonymousParameters->elements.size()) > frame->ip->A)
+                            *sp++ = frame->anonymousParameters->elements[frame->ip->A];
+                        else
+                            *sp++ = Value();
+                    }
+                    else if(frame->anonymousCount > frame->ip->A)
+                        *sp++ = m_stack->bottom()[frame->anonymousBase + frame->ip->A];
                     else
-                        m_stack->emplace_back();
+                        *sp++ = Value();
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
+
+                VM_CASE(OC_LoadArgsArray):// load the current frame's arguments array
+                    if(!frame->anonymousParameters)
+                    {
+                        Value* anonymousBegin = m_stack->bottom() + frame->anonymousBase;
 
-                case OC_LoadArgsArray:// load the current frame's arguments array
-                    m_stack->emplace_back();
-                    m_stack->back().type = Value::VT_Array;
-                    m_stack->back().array = &frame->anonymousParameters;
+                        VM_SYNC();
+                        frame->anonymousParameters = m_memoryman.makeArray();
+                        frame->anonymousParameters->elements.assign(anonymousBegin, anonymousBegin + frame->anonymousCount);
+                    }
+
+                    *sp++ = Value(frame->anonymousParameters);
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
 
-                case OC_LoadThis:// load the current frame's this object
-                    m_stack->emplace_back(frame->thisObject);
+                VM_CASE(OC_LoadThis):// load the current frame's this object
+                    *sp++ = Value(frame->thisObject);
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
 
-                case OC_StoreLocal:// A is the index in the function scope
-                    frame->variables[frame->ip->A] = m_stack->back();
+                VM_CASE(OC_StoreLocal):// A is the index in the function scope
+                    locals[frame->ip->A] = sp[-1];
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
 
-                case OC_StoreGlobal:// A is the index in the global scope
+                VM_CASE(OC_StoreGlobal):// A is the index in the global scope
                 {
                     unsigned index = unsigned(frame->ip->A);
                     if(index >= frame->globals->size())
                         frame->globals->resize(index + 1);
-                    frame->globals->at(index) = m_stack->back();
+                    frame->globals->at(index) = sp[-1];
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_PopStoreLocal:// A is the index in the function scope
-                    frame->variables[frame->ip->A] = m_stack->back();
-                    m_stack->pop_back();
+                VM_CASE(OC_PopStoreLocal):// A is the index in the function scope
+                    locals[frame->ip->A] = sp[-1];
+                    --sp;
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
 
-                case OC_PopStoreGlobal:// A is the index in the global scope
+                VM_CASE(OC_PopStoreGlobal):// A is the index in the global scope
                 {
                     unsigned index = unsigned(frame->ip->A);
                     if(index >= frame->globals->size())
                         frame->globals->resize(index + 1);
-                    frame->globals->at(index) = m_stack->back();
-                    m_stack->pop_back();
+                    frame->globals->at(index) = sp[-1];
+                    --sp;
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_MakeArray:// A is number of elements to be taken from the stack
+                VM_CASE(OC_MakeArray):// A is number of elements to be taken from the stack
                 {
                     int elementsCount = frame->ip->A;
 
+                    VM_SYNC();
                     Array* array = m_memoryman.makeArray();
-                    array->elements.resize(elementsCount);
+                    array->elements.assign(sp - elementsCount, sp);
+                    sp -= elementsCount;
 
-                    for(int i = elementsCount - 1; i >= 0; --i)
-                    {
-                        array->elements[i] = m_stack->back();
-                        m_stack->pop_back();
-                    }
-
-                    m_stack->emplace_back(array);
+                    *sp++ = Value(array);
 
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_LoadElement:// TOS is the index in the TOS1 array or object
+                VM_CASE(OC_LoadElement):// TOS is the index in the TOS1 array or object
                 {
-                    Value index = m_stack->back();
-                    m_stack->pop_back();
+                    Value index = sp[-1];
+                    --sp;
 
-                    Value container = m_stack->back();
-                    m_stack->pop_back();
+                    Value container = sp[-1];
+                    --sp;
 
                     if(container.isArray())
                     {
                         if(!index.isInt())
                         {
                             setError("Array index must be an integer");
-                            return;
+                            VM_EXIT();
                         }
 
-                        m_stack->emplace_back();// the value to get
-                        arrayLoadElement(container.array, index.toInt(), &m_stack->back());
+                        *sp++ = Value();// the value to get
+                        arrayLoadElement(container.array(), index.toInt(), &sp[-1]);
 
                         if(hasError())
-                            return;
+                            VM_EXIT();
                     }
                     else if(container.isObject())
                     {
                         if(!index.isString())
                         {
                             setError("Object index must be a string");
-                            return;
+                            VM_EXIT();
                         }
 
-                        m_stack->emplace_back();// the value to get
-                        loadMemberFromObject(container.object, hashFromName(index.asString()), &m_stack->back());
+                        *sp++ = Value();// the value to get
+                        loadMemberFromObject(container.object(), hashFromName(index.asString()), &sp[-1]);
                     }
                     else// error
                     {
                         setError("The indexing operator only operates on arrays and objects");
-                        return;
+                        VM_EXIT();
                     }
 
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_StoreElement:// TOS index, TOS1 array or object, TOS2 new value
+                VM_CASE(OC_StoreElement):// TOS index, TOS1 array or object, TOS2 new value
                 {
-                    Value index = m_stack->back();
-                    m_stack->pop_back();
+                    Value index = sp[-1];
+                    --sp;
 
-                    Value container = m_stack->back();
-                    m_stack->pop_back();
+                    Value container = sp[-1];
+                    --sp;
 
                     if(container.isArray())
                     {
                         if(!index.isInt())
                         {
                             setError("Array index must be an integer");
-                            return;
+                            VM_EXIT();
                         }
 
-                        arrayStoreElement(container.array, index.toInt(), m_stack->back());
+                        arrayStoreElement(container.array(), index.toInt(), sp[-1]);
 
                         if(hasError())
-                            return;
+                            VM_EXIT();
                     }
                     else if(container.isObject())
                     {
                         if(!index.isString())
                         {
                             setError("Object index must be a string");
-                            return;
+                            VM_EXIT();
                         }
 
-                        objectStoreMember(container.object, hashFromName(index.asString()), m_stack->back());
+                        objectStoreMember(container.object(), hashFromName(index.asString()), sp[-1]);
                     }
                     else// error
                     {
                         setError("The indexing operator only operates on arrays and objects");
-                        return;
+                        VM_EXIT();
                     }
 
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_PopStoreElement:// TOS index, TOS1 array or object, TOS2 new value
+                VM_CASE(OC_PopStoreElement):// TOS index, TOS1 array or object, TOS2 new value
                 {
-                    Value index = m_stack->back();
-                    m_stack->pop_back();
+                    Value index = sp[-1];
+                    --sp;
 
-                    Value container = m_stack->back();
-                    m_stack->pop_back();
+                    Value container = sp[-1];
+                    --sp;
 
                     if(container.isArray())
                     {
                         if(!index.isInt())
                         {
                             setError("Array index must be an integer");
-                            return;
+                            VM_EXIT();
                         }
 
-                        arrayStoreElement(container.array, index.toInt(), m_stack->back());
+                        arrayStoreElement(container.array(), index.toInt(), sp[-1]);
 
                         if(hasError())
-                            return;
+                            VM_EXIT();
 
-                        m_stack->pop_back();
+                        --sp;
                     }
                     else if(container.isObject())
                     {
                         if(!index.isString())
                         {
                             setError("Object index must be a string");
-                            return;
+                            VM_EXIT();
                         }
 
-                        objectStoreMember(container.object, hashFromName(index.asString()), m_stack->back());
-                        m_stack->pop_back();
+                        objectStoreMember(container.object(), hashFromName(index.asString()), sp[-1]);
+                        --sp;
                     }
                     else// error
                     {
                         setError("The indexing operator only operates on arrays and objects");
-                        return;
+                        VM_EXIT();
                     }
 
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_ArrayPushBack:
+                VM_CASE(OC_ArrayPushBack):
                 {
-                    Value newValue = m_stack->back();
-                    m_stack->pop_back();
+                    Value newValue = sp[-1];
+                    --sp;
 
-                    if(m_stack->back().isArray())
+                    if(sp[-1].isArray())
                     {
-                        arrayPushElement(m_stack->back().array, newValue);
-                        m_stack->pop_back();
-                        m_stack->push_back(newValue);
+                        arrayPushElement(sp[-1].array(), newValue);
+                        sp[-1] = newValue;
                     }
                     else
                     {
                         setError("Invalid arguments for operator <<");
-                        return;
+                        VM_EXIT();
                     }
 
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_ArrayPopBack:
+                VM_CASE(OC_ArrayPopBack):
                 {
-                    if(m_stack->back().isArray())
+                    if(sp[-1].isArray())
                     {
-                        Array* array = m_stack->back().array;
-                        m_stack->pop_back();
+                        Array* array = sp[-1].array();
+                        --sp;
 
                         Value popped;
                         if(arrayPopElement(array, &popped))
-                            m_stack->push_back(popped);
+                            *sp++ = popped;
                         else
-                            m_stack->push_back(m_memoryman.makeError("empty-array"));
+                        {
+                            VM_SYNC();
+                            *sp++ = m_memoryman.makeError("empty-array");
+                        }
                     }
                     else
                     {
                         setError("Invalid arguments for operator >>");
-                        return;
+                        VM_EXIT();
                     }
 
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_MakeObject:// A is number of key-value pairs to be taken from the stack
+                VM_CASE(OC_MakeObject):// A is number of key-value pairs to be taken from the stack
                 {
                     int membersCount = frame->ip->A;
 
+                    VM_SYNC();
                     Object* object = m_memoryman.makeObject();
-                    object->members.resize(membersCount);
+                    object->slots.reserve(membersCount);
+
+                    // members are added in the order they were written, so that
+                    // objects made by the same literal share their shape
+                    Value* pairs = sp - 2 * membersCount;
 
-                    for(int i = membersCount - 1; i >= 0; --i)
+                    for(int i = 0; i < membersCount; ++i)
                     {
-                        Object::Member& member = object->members[i];
+                        unsigned hash = pairs[2 * i].asHash();
+                        const Value& value = pairs[2 * i + 1];
 
-                        member.value = m_stack->back();
-                        m_stack->pop_back();
+                        int slot = object->findSlot(hash);
 
-                        member.hash = m_stack->back().asHash();
-                        m_stack->pop_back();
+                        if(slot >= 0)
+                            object->slots[slot] = value;
+                        else
+                            object->addMember(hash, value);
                     }
 
-                    std::sort(object->members.begin(), object->members.end());
-
-                    m_stack->emplace_back(object);
+                    sp -= 2 * membersCount;
+                    *sp++ = Value(object);
 
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_MakeEmptyObject:// make an object with just the proto member value
+                VM_CASE(OC_MakeEmptyObject):// make an object with just the proto member value
                 {
-                    Object* object = m_memoryman.makeObject();
-                    object->members.resize(1);
-
-                    object->members[0].hash = Symbol::ProtoHash;
-
-                    m_stack->emplace_back(object);
+                    VM_SYNC();
+                    *sp++ = Value(m_memoryman.makeObject());
 
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_LoadHash:// H is the hash to load on the stack
-                    m_stack->emplace_back(frame->ip->H);
+                VM_CASE(OC_LoadHash):// H is the hash to load on the stack
+                    *sp++ = Value(frame->ip->H);
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
 
-                case OC_LoadMember:// TOS is the member hash in the TOS1 object
+                VM_CASE(OC_LoadMember):// TOS is the member hash in the TOS1 object
                 {
-                    unsigned hash = m_stack->back().asHash();
-                    m_stack->pop_back();
+                    unsigned hash = sp[-1].asHash();
+                    --sp;
 
-                    if(!m_stack->back().isObject())
+                    if(!sp[-1].isObject())
                     {
                         setError("Attempt to access a member of a non-object value");
-                        return;
+                        VM_EXIT();
                     }
 
-                    m_execctx->lastObject = m_stack->back();
-                    m_stack->pop_back();
-                    m_stack->emplace_back();// the value to get
-                    loadMemberFromObject(m_execctx->lastObject.object, hash, &m_stack->back());
+                    m_execctx->lastObject = sp[-1];
+                    sp[-1] = Value();// the value to get
+                    cachedLoadMember(inlineCaches[frame->ip->A], m_execctx->lastObject.object(), hash, &sp[-1]);
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_StoreMember:// TOS member hash, TOS1 object, TOS2 new value
+                VM_CASE(OC_StoreMember):// TOS member hash, TOS1 object, TOS2 new value
                 {
-                    unsigned hash = m_stack->back().asHash();
-                    m_stack->pop_back();
+                    unsigned hash = sp[-1].asHash();
+                    --sp;
 
-                    if(!m_stack->back().isObject())
+                    if(!sp[-1].isObject())
                     {
                         setError("Attempt to access a member of a non-object value");
-                        return;
+                        VM_EXIT();
                     }
 
-                    Object* object = m_stack->back().object;
-                    m_stack->pop_back();
-                    objectStoreMember(object, hash, m_stack->back());
+                    Object* object = sp[-1].object();
+                    --sp;
+                    cachedStoreMember(inlineCaches[frame->ip->A], object, hash, sp[-1]);
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_PopStoreMember:// TOS member hash, TOS1 object, TOS2 new value
+                VM_CASE(OC_PopStoreMember):// TOS member hash, TOS1 object, TOS2 new value
                 {
-                    unsigned hash = m_stack->back().asHash();
-                    m_stack->pop_back();
+                    unsigned hash = sp[-1].asHash();
+                    --sp;
 
-                    if(!m_stack->back().isObject())
+                    if(!sp[-1].isObject())
                     {
                         setError("Attempt to access a member of a non-object value");
-                        return;
+                        VM_EXIT();
                     }
 
-                    Object* object = m_stack->back().object;
-                    m_stack->pop_back();
-                    objectStoreMember(object, hash, m_stack->back());
-                    m_stack->pop_back();
+                    Object* object = sp[-1].object();
+                    --sp;
+                    cachedStoreMember(inlineCaches[frame->ip->A], object, hash, sp[-1]);
+                    --sp;
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_MakeIterator):// make the iterated value at TOS1 from TOS and push the loop cursor
+                {
+                    if(!sp[-1].isArray() && !sp[-1].isString() && !sp[-1].isIterator())
+                    {
+                        VM_SYNC();
+                        Iterator* iterator = makeIterator(sp[-1]);
+
+                        if(!iterator)// error
+                        {
+                            if(sp[-1].type() == Value::VT_Function && sp[-1].function()->executionContext == nullptr)
+                            {
+                                setError("Cannot iterate a function. Only coroutine instances are iterable.");
+                            }
+                            else
+                            {
+                                setError("Value not iterable.");
+                            }
+                            VM_EXIT();
+                        }
+
+                        sp[-1] = Value(iterator);
+                    }
+
+                    *sp++ = Value(0);// index of the next element for arrays and strings
+                    ++frame->ip;
+                    VM_DISPATCH();
                 }
 
-                case OC_MakeIterator:// make an iterator object from TOS and replace it at TOS
+                VM_CASE(OC_ForIter):// push the next value of TOS1 and skip the 3 generic instructions after it, jump to A when done
                 {
-                    Iterator* iterator = makeIterator(m_stack->back());
+                    Value iterated = sp[-2];
 
-                    if(iterator)
+                    if(iterated.isArray())
                     {
-                        m_stack->pop_back();
-                        m_stack->emplace_back(iterator);
-                        ++frame->ip;
-                        break;
+                        const std::vector<Value>& elements = iterated.array()->elements;
+                        int index = sp[-1].integer();
+
+                        if(unsigned(index) < elements.size())
+                        {
+                            sp[-1] = Value(index + 1);
+                            *sp++ = elements[index];
+                            frame->ip += 4;
+                        }
+                        else
+                        {
+                            frame->ip = &frame->instructions[frame->ip->A];
+                        }
+                        VM_DISPATCH();
                     }
-                    else// error
+
+                    if(iterated.isString())
                     {
-                        if(m_stack->back().type == Value::VT_Function && m_stack->back().function->executionContext == nullptr)
+                        const std::string& str = iterated.string()->str;
+                        int index = sp[-1].integer();
+
+                        if(unsigned(index) < str.size())
                         {
-                            setError("Cannot iterate a function. Only coroutine instances are iterable.");
+                            sp[-1] = Value(index + 1);
+                            VM_SYNC();
+                            *sp++ = m_memoryman.makeString(&str[index], 1);
+                            frame->ip += 4;
                         }
                         else
                         {
-                            setError("Value not iterable.");
+                            frame->ip = &frame->instructions[frame->ip->A];
                         }
-                        return;
+                        VM_DISPATCH();
+                    }
+
+                    IteratorImplementation* ii = iterated.iterator()->implementation;
+
+                    if(ii->kind == IteratorImplementation::IK_Range)
+                    {
+                        RangeIterator* rangeIterator = static_cast<RangeIterator*>(ii);
+
+                        if(rangeIterator->from < rangeIterator->to)
+                        {
+                            *sp++ = Value(rangeIterator->from);
+                            rangeIterator->from += rangeIterator->step;
+                            frame->ip += 4;
+                        }
+                        else
+                        {
+                            frame->ip = &frame->instructions[frame->ip->A];
+                        }
+                    }
+                    else if(ii->kind == IteratorImplementation::IK_Array)
+                    {
+                        ArrayIterator* arrayIterator = static_cast<ArrayIterator*>(ii);
+
+                        if(arrayIterator->currentIndex < arrayIterator->array->elements.size())
+                        {
+                            *sp++ = arrayIterator->array->elements[arrayIterator->currentIndex++];
+                            frame->ip += 4;
+                        }
+                        else
+                        {
+                            frame->ip = &frame->instructions[frame->ip->A];
+                        }
+                    }
+                    else if(ii->kind == IteratorImplementation::IK_String)
+                    {
+                        StringIterator* stringIterator = static_cast<StringIterator*>(ii);
+
+                        if(stringIterator->currentIndex < stringIterator->str->str.size())
+                        {
+                            VM_SYNC();
+                            *sp++ = m_memoryman.makeString(&stringIterator->str->str[stringIterator->currentIndex++], 1);
+                            frame->ip += 4;
+                        }
+                        else
+                        {
+                            frame->ip = &frame->instructions[frame->ip->A];
+                        }
+                    }
+                    else// user objects and coroutines go through 'has_next' and 'get_next'
+                    {
+                        ++frame->ip;
+                    }
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_MakeRange):// turn TOS2 from, TOS1 to, TOS step into TOS2 to, TOS1 step, TOS counter, A is the 'range' arguments count
+                {
+                    if(!sp[-3].isInt() || !sp[-2].isInt() || !sp[-1].isInt())
+                    {
+                        // the same errors the 'range' native gives
+                        if(frame->ip->A == 1)
+                            setError("function 'range(max)' takes an integer as argument");
+                        else if(frame->ip->A == 2)
+                            setError("function 'range(min,max)' takes integers as arguments");
+                        else
+                            setError("function 'range(min,max,step)' takes integers as arguments");
+                        VM_EXIT();
+                    }
+
+                    Value from = sp[-3];
+                    sp[-3] = sp[-2];
+                    sp[-2] = sp[-1];
+                    sp[-1] = from;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_ForRange):// push the TOS counter and advance it by TOS1 while it is below TOS2, otherwise jump to A
+                {
+                    int counter = sp[-1].integer();
+
+                    if(counter < sp[-3].integer())
+                    {
+                        sp[-1] = Value(int(unsigned(counter) + unsigned(sp[-2].integer())));// wraps around like the iterator did
+                        *sp++ = Value(counter);
+                        ++frame->ip;
+                    }
+                    else
+                    {
+                        frame->ip = &frame->instructions[frame->ip->A];
                     }
+                    VM_DISPATCH();
                 }
 
-                case OC_IteratorHasNext:// call 'has_next' from the TOS object
+                VM_CASE(OC_IteratorHasNext):// call 'has_next' from the TOS1 object
                 {
-                    if(m_stack->back().isIterator())
+                    if(sp[-2].isIterator())
                     {
-                        IteratorImplementation* ii = m_stack->back().iterator->implementation;
+                        IteratorImplementation* ii = sp[-2].iterator()->implementation;
 
                         m_execctx->lastObject = ii->thisObjectUsed;
 
-                        m_stack->push_back(ii->hasNextFunction);
+                        *sp++ = ii->hasNextFunction;
+                        VM_SYNC();
 
-                        if(m_stack->back().type == Value::VT_NativeFunction)
+                        if(sp[-1].type() == Value::VT_NativeFunction)
                         {
                             callNative(0);
+                            VM_RELOAD();
 
                             if(hasError())
-                                return;
+                                VM_EXIT();
 
                             ++frame->ip;
                         }
                         else// normal function
                         {
+                            ++frame->ip;// the new frame may move this one
+
+                            ExecutionContext* callerContext = m_execctx;
+
                             call(0);
 
-                            ++frame->ip;
-                            return;
+                            if(m_execctx != callerContext)// runCode carries on in the coroutine
+                                return;
+
+                            frame = &m_execctx->stackFrames.back();
+                            VM_RELOAD();
+                            goto enterFrame;
                         }
                     }
                     else
                     {
                         setError("Value is not an iterator");
-                        return;
+                        VM_EXIT();
                     }
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_IteratorGetNext:// call 'get_next' from the TOS object
+                VM_CASE(OC_IteratorGetNext):// call 'get_next' from the TOS1 object
                 {
-                    if(m_stack->back().isIterator())
+                    if(sp[-2].isIterator())
                     {
-                        IteratorImplementation* ii = m_stack->back().iterator->implementation;
+                        IteratorImplementation* ii = sp[-2].iterator()->implementation;
 
                         m_execctx->lastObject = ii->thisObjectUsed;
 
-                        m_stack->push_back(ii->getNextFunction);
+                        *sp++ = ii->getNextFunction;
+                        VM_SYNC();
 
-                        if(m_stack->back().type == Value::VT_NativeFunction)
+                        if(sp[-1].type() == Value::VT_NativeFunction)
                         {
                             callNative(0);
+                            VM_RELOAD();
 
                             if(hasError())
-                                return;
+                                VM_EXIT();
 
                             ++frame->ip;
                         }
                         else// normal function
                         {
+                            ++frame->ip;// the new frame may move this one
+
+                            ExecutionContext* callerContext = m_execctx;
+
                             call(0);
 
-                            ++frame->ip;
-                            return;
+                            if(m_execctx != callerContext)// runCode carries on in the coroutine
+                                return;
+
+                            frame = &m_execctx->stackFrames.back();
+                            VM_RELOAD();
+                            goto enterFrame;
                         }
                     }
                     else
                     {
                         setError("Value is not an iterator");
-                        return;
+                        VM_EXIT();
                     }
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_MakeBox:// A is the index of the box that needs to be created
+                VM_CASE(OC_MakeBox):// A is the index of the box that needs to be created
                 {
-                    Value& variable = frame->variables[frame->ip->A];
+                    Value& variable = locals[frame->ip->A];
+                    VM_SYNC();
                     variable = m_memoryman.makeBox(variable);
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_LoadFromBox:// load the value stored in the box at index A
-                    m_stack->emplace_back(frame->variables[frame->ip->A].box->value);
+                VM_CASE(OC_LoadFromBox):// load the value stored in the box at index A
+                    *sp++ = Value(locals[frame->ip->A].box()->value);
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
 
-                case OC_StoreToBox:// A is the index of the box that holds the value
+                VM_CASE(OC_StoreToBox):// A is the index of the box that holds the value
                 {
-                    Box* box = frame->variables[frame->ip->A].box;
-                    Value& newValue = m_stack->back();
+                    Box* box = locals[frame->ip->A].box();
+                    Value& newValue = sp[-1];
 
                     box->value = newValue;
 
                     m_memoryman.updateGCRelationship(box, newValue);
 
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_PopStoreToBox:// A is the index of the box that holds the value
+                VM_CASE(OC_PopStoreToBox):// A is the index of the box that holds the value
                 {
-                    Box* box = frame->variables[frame->ip->A].box;
-                    Value& newValue = m_stack->back();
+                    Box* box = locals[frame->ip->A].box();
+                    Value& newValue = sp[-1];
 
                     box->value = newValue;
 
                     m_memoryman.updateGCRelationship(box, newValue);
 
-                    m_stack->pop_back();
+                    --sp;
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_MakeClosure:// Create a closure from the function object at TOS and replace it
+                VM_CASE(OC_MakeClosure):// Create a closure from the function object at TOS and replace it
                 {
-                    Function* newFunction = m_memoryman.makeFunction(m_stack->back().function);
+                    VM_SYNC();
+                    Function* newFunction = m_memoryman.makeFunction(sp[-1].function());
 
                     const std::vector<int>& closureMapping = newFunction->codeObject->closureMapping;
 
@@ -1089,267 +1531,1012 @@ namespace element
                     for(int indexToBox : closureMapping)
                     {
                         if(indexToBox >= 0)
-                            newFunction->freeVariables.push_back(frame->variables[indexToBox].box);
+                            newFunction->freeVariables.push_back(locals[indexToBox].box());
                         else// from a free variable
                             newFunction->freeVariables.push_back(frame->function->freeVariables[-indexToBox - 1]);
                     }
 
-                    m_stack->back() = Value(newFunction);
+                    sp[-1] = Value(newFunction);
 
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_LoadFromClosure:// load the value of the free variable inside the closure at index A
-                    m_stack->emplace_back(frame->function->freeVariables[frame->ip->A]->value);
+                VM_CASE(OC_LoadFromClosure):// load the value of the free variable inside the closure at index A
+                    *sp++ = Value(frame->function->freeVariables[frame->ip->A]->value);
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
 
-                case OC_StoreToClosure:// A is the index of the free variable inside the closure
+                VM_CASE(OC_StoreToClosure):// A is the index of the free variable inside the closure
                 {
                     Box* box = frame->function->freeVariables[frame->ip->A];
-                    Value& newValue = m_stack->back();
+                    Value& newValue = sp[-1];
 
                     box->value = newValue;
 
                     m_memoryman.updateGCRelationship(box, newValue);
 
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_PopStoreToClosure:// A is the index of the free variable inside the closure
+                VM_CASE(OC_PopStoreToClosure):// A is the index of the free variable inside the closure
                 {
                     Box* box = frame->function->freeVariables[frame->ip->A];
-                    Value& newValue = m_stack->back();
+                    Value& newValue = sp[-1];
 
                     box->value = newValue;
 
                     m_memoryman.updateGCRelationship(box, newValue);
 
-                    m_stack->pop_back();
+                    --sp;
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_Jump:// jump to A
+                VM_CASE(OC_Jump):// jump to A
+                    VM_SAFEPOINT();
                     frame->ip = &frame->instructions[frame->ip->A];
-                    break;
+                    VM_DISPATCH();
 
-                case OC_JumpIfFalse:// jump to A, if TOS is false
-                    if(m_stack->back().asBool())
+                VM_CASE(OC_JumpIfFalse):// jump to A, if TOS is false
+                    if(sp[-1].asBool())
                         ++frame->ip;
                     else
                         frame->ip = &frame->instructions[frame->ip->A];
-                    break;
+                    VM_DISPATCH();
 
-                case OC_PopJumpIfFalse:// jump to A, if TOS is false, pop TOS either way
-                    if(m_stack->back().asBool())
+                VM_CASE(OC_PopJumpIfFalse):// jump to A, if TOS is false, pop TOS either way
+                    if(sp[-1].asBool())
                         ++frame->ip;
                     else
                         frame->ip = &frame->instructions[frame->ip->A];
-                    m_stack->pop_back();
-                    break;
+                    --sp;
+                    VM_DISPATCH();
 
-                case OC_JumpIfFalseOrPop:// jump to A, if TOS is false, otherwise pop TOS (and-op)
-                    if(m_stack->back().asBool())
+                VM_CASE(OC_JumpIfFalseOrPop):// jump to A, if TOS is false, otherwise pop TOS (and-op)
+                    if(sp[-1].asBool())
                     {
-                        m_stack->pop_back();
+                        --sp;
                         ++frame->ip;
                     }
                     else
                     {
                         frame->ip = &frame->instructions[frame->ip->A];
                     }
-                    break;
+                    VM_DISPATCH();
 
-                case OC_JumpIfTrueOrPop:// jump to A, if TOS is true, otherwise pop TOS (or-op)
-                    if(m_stack->back().asBool())
+                VM_CASE(OC_JumpIfTrueOrPop):// jump to A, if TOS is true, otherwise pop TOS (or-op)
+                    if(sp[-1].asBool())
                     {
                         frame->ip = &frame->instructions[frame->ip->A];
                     }
                     else
                     {
-                        m_stack->pop_back();
+                        --sp;
                         ++frame->ip;
                     }
-                    break;
+                    VM_DISPATCH();
 
-                case OC_FunctionCall:// function to call and arguments are on stack, A is arguments count
-                    if(!m_stack->back().isFunction())
+                VM_CASE(OC_FunctionCall):// function to call and arguments are on stack, A is arguments count
+                    if(!sp[-1].isFunction())
                     {
                         setError("Attempt to call a non-function value");
-                        return;
+                        VM_EXIT();
                     }
 
-                    if(m_stack->back().type == Value::VT_NativeFunction)
+                    VM_SYNC();
+
+                    if(sp[-1].type() == Value::VT_NativeFunction)
                     {
                         callNative(frame->ip->A);
+                        VM_RELOAD();
 
                         if(hasError())
-                            return;
+                            VM_EXIT();
 
                         ++frame->ip;
                     }
                     else// normal function
                     {
-                        call(frame->ip->A);
+                        int argumentsCount = frame->ip->A;
+                        ++frame->ip;// the new frame may move this one
 
-                        ++frame->ip;
-                        return;
-                    }
-                    break;
+                        ExecutionContext* callerContext = m_execctx;
+
+                        call(argumentsCount);
+
+                        if(m_execctx != callerContext)// runCode carries on in the coroutine
+                            return;
 
-                case OC_Yield:// yield the value from TOS to the parent execution context
+                        frame = &m_execctx->stackFrames.back();
+                        VM_RELOAD();
+
+                        if(hasError())
+                            VM_EXIT();
+
+                        goto enterFrame;
+                    }
+                    VM_DISPATCH();
+
+                VM_CASE(OC_Yield):// yield the value from TOS to the parent execution context
                 {
                     if(!m_execctx->parent)
                     {
                         setError("Attempt to yield while not in a coroutine");
-                        return;
+                        VM_EXIT();
                     }
 
-                    Value yieldValue = m_stack->back();
-                    m_stack->pop_back();
+                    Value yieldValue = sp[-1];
+                    --sp;
+                    VM_SYNC();
+
+                    // its stack was written without barriers and is no root once suspended
+                    m_memoryman.rememberObject(m_execctx->stackFrames.front().function);
 
                     // switch context
                     m_execctx = m_execctx->parent;
                     m_stack = &m_execctx->stack;
 
-                    m_stack->push_back(yieldValue);
+                    m_stack->push(yieldValue);
 
                     ++frame->ip;
                     return;
                 }
 
-                case OC_EndFunction:// end function sentinel
+                VM_CASE(OC_EndFunction):// end function sentinel
+                {
+                    // an error left by the function stops here, before the caller goes on
+                    if(hasError())
+                        VM_EXIT();
+
+                    // drop the locals and leftovers of the frame, the result stays on top
+                    locals[0] = sp[-1];
+                    sp = locals + 1;
+                    VM_SYNC();
+
                     m_execctx->stackFrames.pop_back();
 
-                    if(m_execctx->stackFrames.empty())
+                    // the stack barrier, the frame returned to changes again and is scanned anew
+                    if(m_execctx->scannedFrames >= m_execctx->stackFrames.size())
+                        m_execctx->scannedFrames = unsigned(std::max<size_t>(m_execctx->stackFrames.size(), 1) - 1);
+
+                    if(!m_execctx->stackFrames.empty())// back to the caller
                     {
-                        m_execctx->state = ExecutionContext::CRS_Finished;
+                        frame = &m_execctx->stackFrames.back();
+                        goto enterFrame;
+                    }
 
-                        if(m_execctx->parent)
-                        {
-                            Value yieldValue = m_stack->back();
-                            m_stack->pop_back();
+                    m_execctx->state = ExecutionContext::CRS_Finished;
 
-                            // switch context
-                            m_execctx = m_execctx->parent;
-                            m_stack = &m_execctx->stack;
+                    if(m_execctx->parent)
+                    {
+                        Value yieldValue = m_stack->back();
+                        m_stack->pop();
+                        m_execctx->lastObject = Value();// nothing scans the finished coroutine for young objects
 
-                            m_stack->push_back(yieldValue);
-                        }
+                        // switch context
+                        m_execctx = m_execctx->parent;
+                        m_stack = &m_execctx->stack;
+
+                        m_stack->push(yieldValue);
                     }
                     return;
+                }
+
+                VM_CASE(OC_Add):
+                VM_CASE(OC_Subtract):
+                VM_CASE(OC_Multiply):
+                VM_CASE(OC_Divide):
+                VM_CASE(OC_Power):
+                VM_CASE(OC_Modulo):
+                VM_CASE(OC_Concatenate):
+                VM_CASE(OC_Xor):
+
+                VM_CASE(OC_Equal):
+                VM_CASE(OC_NotEqual):
+                VM_CASE(OC_Less):
+                VM_CASE(OC_Greater):
+                VM_CASE(OC_LessEqual):
+                VM_CASE(OC_GreaterEqual):
+                    if(frame->ip->A == 0)// never deoptimized, specialize it for the operand types
+                    {
+                        OpCode specialized = specializedBinaryOperation(frame->ip->opCode, sp[-2], sp[-1]);
+
+                        if(specialized != frame->ip->opCode)
+                        {
+                            VM_REWRITE(specialized);
+                            VM_DISPATCH();
+                        }
+                    }
+
+                    VM_SYNC();
 
-                case OC_Add:
-                case OC_Subtract:
-                case OC_Multiply:
-                case OC_Divide:
-                case OC_Power:
-                case OC_Modulo:
-                case OC_Concatenate:
-                case OC_Xor:
-
-                case OC_Equal:
-                case OC_NotEqual:
-                case OC_Less:
-                case OC_Greater:
-                case OC_LessEqual:
-                case OC_GreaterEqual:
                     if(!doBinaryOperation(frame->ip->opCode))
                         return;
 
+                    VM_RELOAD();
+
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
 
-                case OC_UnaryPlus:
-                    if(!m_stack->back().isNumber())
+                VM_CASE(OC_UnaryPlus):
+                    if(!sp[-1].isNumber())
                     {
                         setError("Unary plus used on a value that is not an integer or float");
-                        return;
+                        VM_EXIT();
                     }
 
                     ++frame->ip;// do nothing (:
-                    break;
+                    VM_DISPATCH();
 
-                case OC_UnaryMinus:
-                    if(m_stack->back().isInt())
-                    {
-                        int i = m_stack->back().toInt();
-                        m_stack->pop_back();
-                        m_stack->emplace_back(-i);
-                    }
-                    else if(m_stack->back().isFloat())
-                    {
-                        float f = m_stack->back().asFloat();
-                        m_stack->pop_back();
-                        m_stack->emplace_back(-f);
-                    }
+                VM_CASE(OC_UnaryMinus):
+                    if(sp[-1].isInt())
+                        sp[-1] = Value(-sp[-1].toInt());
+                    else if(sp[-1].isFloat())
+                        sp[-1] = Value(-sp[-1].asFloat());
                     else
                     {
                         setError("Unary minus used on a value that is not an integer or float");
-                        return;
+                        VM_EXIT();
                     }
 
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
 
-                case OC_UnaryNot:
+                VM_CASE(OC_UnaryNot):
                 {
-                    bool b = m_stack->back().asBool();// anything can be turned into a bool
-                    m_stack->pop_back();
-                    m_stack->emplace_back(!b);
+                    sp[-1] = Value(!sp[-1].asBool());// anything can be turned into a bool
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_UnaryConcatenate:
+                VM_CASE(OC_UnaryConcatenate):
                 {
-                    std::string str = m_stack->back().asString();// anything can be turned into a string
-                    m_stack->pop_back();
-                    m_stack->emplace_back(m_memoryman.makeString(str));
+                    std::string str = sp[-1].asString();// anything can be turned into a string
+                    VM_SYNC();
+                    sp[-1] = Value(m_memoryman.makeString(str));
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                case OC_UnarySizeOf:
+                VM_CASE(OC_UnarySizeOf):
                 {
-                    const Value& value = m_stack->back();
+                    const Value& value = sp[-1];
                     int size = 0;
 
                     if(value.isArray())
-                        size = int(value.array->elements.size());
+                        size = int(value.array()->elements.size());
                     else if(value.isObject())
-                        size = int(value.object->members.size());
+                        size = int(value.object()->membersCount());
                     else if(value.isString())
-                        size = int(value.string->str.size());
+                        size = int(value.string()->str.size());
                     else
                     {
                         setError("Attempt to get the size of a value that is not an array, object or string");
-                        return;
+                        VM_EXIT();
                     }
 
-                    m_stack->pop_back();
-                    m_stack->emplace_back(size);
+                    sp[-1] = Value(size);
 
                     ++frame->ip;
-                    break;
+                    VM_DISPATCH();
                 }
 
-                default:
+                VM_CASE(OC_AddIntInt):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isInt() || !rhs.isInt())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.integer() + rhs.integer());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_AddFloatFloat):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isFloat() || !rhs.isFloat())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.floatingPoint() + rhs.floatingPoint());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_SubtractIntInt):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isInt() || !rhs.isInt())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.integer() - rhs.integer());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_SubtractFloatFloat):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isFloat() || !rhs.isFloat())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.floatingPoint() - rhs.floatingPoint());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_MultiplyIntInt):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isInt() || !rhs.isInt())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.integer() * rhs.integer());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_MultiplyFloatFloat):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isFloat() || !rhs.isFloat())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.floatingPoint() * rhs.floatingPoint());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_DivideIntInt):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isInt() || !rhs.isInt() || rhs.integer() == 0)
+                        goto deoptimize;
+
+                    lhs = Value(lhs.integer() / rhs.integer());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_DivideFloatFloat):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isFloat() || !rhs.isFloat() || rhs.floatingPoint() == 0)
+                        goto deoptimize;
+
+                    lhs = Value(lhs.floatingPoint() / rhs.floatingPoint());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_ModuloIntInt):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isInt() || !rhs.isInt() || rhs.integer() == 0)
+                        goto deoptimize;
+
+                    lhs = Value(lhs.integer() % rhs.integer());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_ConcatenateStrStr):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isString() || !rhs.isString())
+                        goto deoptimize;
+
+                    VM_SYNC();
+                    lhs = m_memoryman.makeString(lhs.string()->str + rhs.string()->str);
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_EqualIntInt):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isInt() || !rhs.isInt())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.integer() == rhs.integer());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_NotEqualIntInt):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isInt() || !rhs.isInt())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.integer() != rhs.integer());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_LessIntInt):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isInt() || !rhs.isInt())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.integer() < rhs.integer());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_LessFloatFloat):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isFloat() || !rhs.isFloat())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.floatingPoint() < rhs.floatingPoint());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_GreaterIntInt):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isInt() || !rhs.isInt())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.integer() > rhs.integer());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_GreaterFloatFloat):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isFloat() || !rhs.isFloat())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.floatingPoint() > rhs.floatingPoint());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_LessEqualIntInt):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isInt() || !rhs.isInt())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.integer() <= rhs.integer());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_LessEqualFloatFloat):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isFloat() || !rhs.isFloat())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.floatingPoint() <= rhs.floatingPoint());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_GreaterEqualIntInt):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isInt() || !rhs.isInt())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.integer() >= rhs.integer());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_GreaterEqualFloatFloat):
+                {
+                    Value& lhs = sp[-2];
+                    const Value& rhs = sp[-1];
+
+                    if(!lhs.isFloat() || !rhs.isFloat())
+                        goto deoptimize;
+
+                    lhs = Value(lhs.floatingPoint() >= rhs.floatingPoint());
+                    --sp;
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                // the superinstructions read the operands of the instructions they stand for
+                // from those, they run just the first one when the types don't fit
+                VM_CASE(OC_LoadLocalLocal):
+                    sp[0] = locals[frame->ip[0].A];
+                    sp[1] = locals[frame->ip[1].A];
+                    sp += 2;
+                    frame->ip += 2;
+                    VM_DISPATCH();
+
+                VM_CASE(OC_LoadGlobalGlobal):
+                {
+                    unsigned first = unsigned(frame->ip[0].A);
+                    unsigned second = unsigned(frame->ip[1].A);
+                    sp[0] = first < frame->globals->size() ? frame->globals->at(first) : Value();
+                    sp[1] = second < frame->globals->size() ? frame->globals->at(second) : Value();
+                    sp += 2;
+                    frame->ip += 2;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_LoadLocalConstant):
+                    sp[0] = locals[frame->ip[0].A];
+                    sp[1] = m_constants[frame->ip[1].A];
+                    sp += 2;
+                    frame->ip += 2;
+                    VM_DISPATCH();
+
+                VM_CASE(OC_AddLocalLocal):// LoadLocal, LoadLocal, Add
+                {
+                    const Value& lhs = locals[frame->ip[0].A];
+                    const Value& rhs = locals[frame->ip[1].A];
+
+                    if(lhs.isInt() && rhs.isInt())
+                        *sp++ = Value(lhs.integer() + rhs.integer());
+                    else if(lhs.isFloat() && rhs.isFloat())
+                        *sp++ = Value(lhs.floatingPoint() + rhs.floatingPoint());
+                    else
+                    {
+                        *sp++ = lhs;
+                        ++frame->ip;
+                        VM_DISPATCH();
+                    }
+
+                    frame->ip += 3;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_AddLocalConstantStore):// LoadLocal, LoadConstant, Add, PopStoreLocal
+                {
+                    const Value& lhs = locals[frame->ip[0].A];
+                    const Value& rhs = m_constants[frame->ip[1].A];
+
+                    if(lhs.isInt() && rhs.isInt())
+                        locals[frame->ip[3].A] = Value(lhs.integer() + rhs.integer());
+                    else if(lhs.isFloat() && rhs.isFloat())
+                        locals[frame->ip[3].A] = Value(lhs.floatingPoint() + rhs.floatingPoint());
+                    else
+                    {
+                        *sp++ = lhs;
+                        ++frame->ip;
+                        VM_DISPATCH();
+                    }
+
+                    frame->ip += 4;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_LessLocalConstantJump):// LoadLocal, LoadConstant, Less, PopJumpIfFalse
+                {
+                    const Value& lhs = locals[frame->ip[0].A];
+                    const Value& rhs = m_constants[frame->ip[1].A];
+                    bool less;
+
+                    if(lhs.isInt() && rhs.isInt())
+                        less = lhs.integer() < rhs.integer();
+                    else if(lhs.isFloat() && rhs.isFloat())
+                        less = lhs.floatingPoint() < rhs.floatingPoint();
+                    else
+                    {
+                        *sp++ = lhs;
+                        ++frame->ip;
+                        VM_DISPATCH();
+                    }
+
+                    if(less)
+                        frame->ip += 4;
+                    else
+                        frame->ip = &frame->instructions[frame->ip[3].A];
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_LoadHashMember):// LoadHash, LoadMember of the TOS object
+                    if(!sp[-1].isObject())// LoadMember gives the error
+                    {
+                        *sp++ = Value(frame->ip->H);
+                        ++frame->ip;
+                        VM_DISPATCH();
+                    }
+
+                    m_execctx->lastObject = sp[-1];
+                    sp[-1] = Value();// the value to get
+                    cachedLoadMember(inlineCaches[frame->ip[1].A], m_execctx->lastObject.object(), frame->ip[0].H, &sp[-1]);
+                    frame->ip += 2;
+                    VM_DISPATCH();
+
+                // the register instructions, B and C are read here and the operation done
+                // in the part shared by the two variants of C
+                VM_CASE(OC_MoveRegister):
+                    locals[frame->ip->A] = locals[frame->ip->C];
+                    ++frame->ip;
+                    VM_DISPATCH();
+
+                VM_CASE(OC_MoveConstant):
+                    locals[frame->ip->A] = m_constants[frame->ip->C];
+                    ++frame->ip;
+                    VM_DISPATCH();
+
+                VM_CASE(OC_AddRegisters):
+                    registerC = &locals[frame->ip->C];
+                    goto registerAdd;
+
+                VM_CASE(OC_AddRegisterConstant):
+                    registerC = &m_constants[frame->ip->C];
+
+                registerAdd:
+                {
+                    const Value& lhs = locals[frame->ip->B];
+
+                    if(lhs.isInt() && registerC->isInt())
+                        locals[frame->ip->A] = Value(lhs.integer() + registerC->integer());
+                    else if(lhs.isFloat() && registerC->isFloat())
+                        locals[frame->ip->A] = Value(lhs.floatingPoint() + registerC->floatingPoint());
+                    else
+                    {
+                        registerOperator = OC_Add;
+                        goto registerFallback;
+                    }
+
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_SubtractRegisters):
+                    registerC = &locals[frame->ip->C];
+                    goto registerSubtract;
+
+                VM_CASE(OC_SubtractRegisterConstant):
+                    registerC = &m_constants[frame->ip->C];
+
+                registerSubtract:
+                {
+                    const Value& lhs = locals[frame->ip->B];
+
+                    if(lhs.isInt() && registerC->isInt())
+                        locals[frame->ip->A] = Value(lhs.integer() - registerC->integer());
+                    else if(lhs.isFloat() && registerC->isFloat())
+                        locals[frame->ip->A] = Value(lhs.floatingPoint() - registerC->floatingPoint());
+                    else
+                    {
+                        registerOperator = OC_Subtract;
+                        goto registerFallback;
+                    }
+
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_MultiplyRegisters):
+                    registerC = &locals[frame->ip->C];
+                    goto registerMultiply;
+
+                VM_CASE(OC_MultiplyRegisterConstant):
+                    registerC = &m_constants[frame->ip->C];
+
+                registerMultiply:
+                {
+                    const Value& lhs = locals[frame->ip->B];
+
+                    if(lhs.isInt() && registerC->isInt())
+                        locals[frame->ip->A] = Value(lhs.integer() * registerC->integer());
+                    else if(lhs.isFloat() && registerC->isFloat())
+                        locals[frame->ip->A] = Value(lhs.floatingPoint() * registerC->floatingPoint());
+                    else
+                    {
+                        registerOperator = OC_Multiply;
+                        goto registerFallback;
+                    }
+
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_DivideRegisters):
+                    registerC = &locals[frame->ip->C];
+                    goto registerDivide;
+
+                VM_CASE(OC_DivideRegisterConstant):
+                    registerC = &m_constants[frame->ip->C];
+
+                registerDivide:
+                {
+                    const Value& lhs = locals[frame->ip->B];
+
+                    if(lhs.isInt() && registerC->isInt() && registerC->integer() != 0)
+                        locals[frame->ip->A] = Value(lhs.integer() / registerC->integer());
+                    else if(lhs.isFloat() && registerC->isFloat() && registerC->floatingPoint() != 0)
+                        locals[frame->ip->A] = Value(lhs.floatingPoint() / registerC->floatingPoint());
+                    else
+                    {
+                        registerOperator = OC_Divide;
+                        goto registerFallback;
+                    }
+
+                    ++frame->ip;
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_EqualRegistersJump):
+                    registerC = &locals[frame->ip->C];
+                    goto registerEqualJump;
+
+                VM_CASE(OC_EqualRegisterConstantJump):
+                    registerC = &m_constants[frame->ip->C];
+
+                registerEqualJump:
+                {
+                    const Value& lhs = locals[frame->ip->B];
+                    bool result;
+
+                    if(lhs.isInt() && registerC->isInt())
+                        result = lhs.integer() == registerC->integer();
+                    else if(lhs.isFloat() && registerC->isFloat())
+                        result = lhs.floatingPoint() == registerC->floatingPoint();
+                    else
+                    {
+                        registerOperator = OC_Equal;
+                        goto registerFallback;
+                    }
+
+                    if(result)
+                        ++frame->ip;
+                    else
+                        frame->ip = &frame->instructions[frame->ip->A];
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_NotEqualRegistersJump):
+                    registerC = &locals[frame->ip->C];
+                    goto registerNotEqualJump;
+
+                VM_CASE(OC_NotEqualRegisterConstantJump):
+                    registerC = &m_constants[frame->ip->C];
+
+                registerNotEqualJump:
+                {
+                    const Value& lhs = locals[frame->ip->B];
+                    bool result;
+
+                    if(lhs.isInt() && registerC->isInt())
+                        result = lhs.integer() != registerC->integer();
+                    else if(lhs.isFloat() && registerC->isFloat())
+                        result = lhs.floatingPoint() != registerC->floatingPoint();
+                    else
+                    {
+                        registerOperator = OC_NotEqual;
+                        goto registerFallback;
+                    }
+
+                    if(result)
+                        ++frame->ip;
+                    else
+                        frame->ip = &frame->instructions[frame->ip->A];
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_LessRegistersJump):
+                    registerC = &locals[frame->ip->C];
+                    goto registerLessJump;
+
+                VM_CASE(OC_LessRegisterConstantJump):
+                    registerC = &m_constants[frame->ip->C];
+
+                registerLessJump:
+                {
+                    const Value& lhs = locals[frame->ip->B];
+                    bool result;
+
+                    if(lhs.isInt() && registerC->isInt())
+                        result = lhs.integer() < registerC->integer();
+                    else if(lhs.isFloat() && registerC->isFloat())
+                        result = lhs.floatingPoint() < registerC->floatingPoint();
+                    else
+                    {
+                        registerOperator = OC_Less;
+                        goto registerFallback;
+                    }
+
+                    if(result)
+                        ++frame->ip;
+                    else
+                        frame->ip = &frame->instructions[frame->ip->A];
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_GreaterRegistersJump):
+                    registerC = &locals[frame->ip->C];
+                    goto registerGreaterJump;
+
+                VM_CASE(OC_GreaterRegisterConstantJump):
+                    registerC = &m_constants[frame->ip->C];
+
+                registerGreaterJump:
+                {
+                    const Value& lhs = locals[frame->ip->B];
+                    bool result;
+
+                    if(lhs.isInt() && registerC->isInt())
+                        result = lhs.integer() > registerC->integer();
+                    else if(lhs.isFloat() && registerC->isFloat())
+                        result = lhs.floatingPoint() > registerC->floatingPoint();
+                    else
+                    {
+                        registerOperator = OC_Greater;
+                        goto registerFallback;
+                    }
+
+                    if(result)
+                        ++frame->ip;
+                    else
+                        frame->ip = &frame->instructions[frame->ip->A];
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_LessEqualRegistersJump):
+                    registerC = &locals[frame->ip->C];
+                    goto registerLessEqualJump;
+
+                VM_CASE(OC_LessEqualRegisterConstantJump):
+                    registerC = &m_constants[frame->ip->C];
+
+                registerLessEqualJump:
+                {
+                    const Value& lhs = locals[frame->ip->B];
+                    bool result;
+
+                    if(lhs.isInt() && registerC->isInt())
+                        result = lhs.integer() <= registerC->integer();
+                    else if(lhs.isFloat() && registerC->isFloat())
+                        result = lhs.floatingPoint() <= registerC->floatingPoint();
+                    else
+                    {
+                        registerOperator = OC_LessEqual;
+                        goto registerFallback;
+                    }
+
+                    if(result)
+                        ++frame->ip;
+                    else
+                        frame->ip = &frame->instructions[frame->ip->A];
+                    VM_DISPATCH();
+                }
+
+                VM_CASE(OC_GreaterEqualRegistersJump):
+                    registerC = &locals[frame->ip->C];
+                    goto registerGreaterEqualJump;
+
+                VM_CASE(OC_GreaterEqualRegisterConstantJump):
+                    registerC = &m_constants[frame->ip->C];
+
+                registerGreaterEqualJump:
+                {
+                    const Value& lhs = locals[frame->ip->B];
+                    bool result;
+
+                    if(lhs.isInt() && registerC->isInt())
+                        result = lhs.integer() >= registerC->integer();
+                    else if(lhs.isFloat() && registerC->isFloat())
+                        result = lhs.floatingPoint() >= registerC->floatingPoint();
+                    else
+                    {
+                        registerOperator = OC_GreaterEqual;
+                        goto registerFallback;
+                    }
+
+                    if(result)
+                        ++frame->ip;
+                    else
+                        frame->ip = &frame->instructions[frame->ip->A];
+                    VM_DISPATCH();
+                }
+
+                registerFallback:// the operator of the stack instructions does it, on the operands pushed
+                    sp[0] = locals[frame->ip->B];
+                    sp[1] = *registerC;
+                    sp += 2;
+
+                    VM_SYNC();
+
+                    if(!doBinaryOperation(registerOperator))
+                        return;
+
+                    VM_RELOAD();
+                    --sp;
+
+                    if(!isJump(frame->ip->opCode))
+                    {
+                        locals[frame->ip->A] = *sp;
+                        ++frame->ip;
+                    }
+                    else if(sp->asBool())
+                        ++frame->ip;
+                    else
+                        frame->ip = &frame->instructions[frame->ip->A];
+                    VM_DISPATCH();
+
+                deoptimize:// a specialized binary operation got operands of other types
+                    VM_REWRITE(genericBinaryOperation(frame->ip->opCode));
+                    const_cast<Instruction*>(frame->ip)->A = 1;// don't specialize it again
+                    VM_DISPATCH();
+
+                VM_DEFAULT:
                     setError("Invalid OpCode!");
-                    return;
+                    VM_EXIT();
             }
         }
     }
 
     void VirtualMachine::call(int argumentsCount)
     {
-        Function* function = m_stack->back().function;
-        m_stack->pop_back();
+        Function* function = m_stack->back().function();
+        m_stack->pop();
 
-        std::vector<Value>* sourceStack = m_stack;
+        ValueStack* sourceStack = m_stack;
 
         if(function->executionContext)
         {
@@ -1362,15 +2549,13 @@ namespace element
                 if(argumentsCount == 1)
                 {
                     valueToSend = m_stack->back();
-                    m_stack->pop_back();
+                    m_stack->pop();
                 }
                 else if(argumentsCount > 1)// we need to pack them into an array
                 {
                     Array* array = m_memoryman.makeArray();
-                    array->elements.resize(argumentsCount);
-
-                    std::copy(m_stack->end() - argumentsCount, m_stack->end(), array->elements.begin());
-                    m_stack->resize(m_stack->size() - argumentsCount);
+                    array->elements.assign(m_stack->top - argumentsCount, m_stack->top);
+                    m_stack->top -= argumentsCount;
 
                     valueToSend = Value(array);
                 }
@@ -1379,13 +2564,13 @@ namespace element
                 m_execctx = function->executionContext;
                 m_stack = &m_execctx->stack;
 
-                m_stack->push_back(valueToSend);
+                m_stack->push(valueToSend);// in place of the value it yielded
                 return;
             }
             if(function->executionContext->state == ExecutionContext::CRS_Finished)
             {
-                m_stack->resize(m_stack->size() - argumentsCount);
-                m_stack->push_back(m_memoryman.makeError("dead-coroutine"));
+                m_stack->top -= argumentsCount;
+                m_stack->push(m_memoryman.makeError("dead-coroutine"));
                 return;
             }
             if(function->executionContext->state == ExecutionContext::CRS_NotStarted)
@@ -1412,43 +2597,52 @@ namespace element
         newFrame->thisObject = m_execctx->lastObject;
         newFrame->globals = &codeObject->module->globals;
 
-        newFrame->variables.resize(codeObject->localVariablesCount);
-
         // bind parameters to local variables //////////////////////////////////////
-        int anonymousCount = argumentsCount - codeObject->namedParametersCount;
-
-        if(anonymousCount <= 0)
+        // the arguments on top of the stack become the first locals of the frame
+        if(sourceStack != m_stack)// a coroutine starting, move them to its own stack
         {
-            std::copy(sourceStack->end() - argumentsCount, sourceStack->end(), newFrame->variables.begin());
+            m_stack->reserve(argumentsCount);
+            m_stack->top = std::copy(sourceStack->top - argumentsCount, sourceStack->top, m_stack->top);
+            sourceStack->top -= argumentsCount;
         }
-        else// we have some anonymous arguments
+
+        int anonymousCount = std::max(argumentsCount - codeObject->namedParametersCount, 0);
+
+        // room for the locals, the anonymous arguments past them and the operands
+        m_stack->reserve(codeObject->localVariablesCount + anonymousCount + codeObject->maxStackDepth - argumentsCount);
+
+        newFrame->base = m_stack->size() - argumentsCount;
+        newFrame->anonymousBase = newFrame->base + codeObject->localVariablesCount;
+
+        if(anonymousCount > 0)// move them past the locals
         {
-            newFrame->anonymousParameters.elements.resize(anonymousCount);
+            m_stack->resize(newFrame->anonymousBase + anonymousCount);
 
-            std::copy(sourceStack->end() - argumentsCount, sourceStack->end() - anonymousCount, newFrame->variables.begin());
-            std::copy(sourceStack->end() - anonymousCount, sourceStack->end(), newFrame->anonymousParameters.elements.begin());
-        }
+            Value* anonymousBegin = m_stack->bottom() + newFrame->base + codeObject->namedParametersCount;
+            Value* anonymousDestination = m_stack->bottom() + newFrame->anonymousBase;
+
+            std::copy_backward(anonymousBegin, anonymousBegin + anonymousCount, anonymousDestination + anonymousCount);
+            std::fill(anonymousBegin, anonymousDestination, Value());
 
-        sourceStack->resize(sourceStack->size() - argumentsCount);
+            newFrame->anonymousCount = anonymousCount;
+        }
+        else
+        {
+            m_stack->resize(newFrame->anonymousBase);
+        }
     }
 
     void VirtualMachine::callNative(int argumentsCount)
     {
-        Value::NativeFunction function = m_stack->back().nativeFunction;
-        m_stack->pop_back();
+        const Native* native = m_stack->back().native();
 
-        std::vector<Value> arguments;
-        arguments.resize(argumentsCount);
+        // the arguments stay on the stack while the function runs, to keep them alive
+        Arguments arguments(m_stack->top - 1 - argumentsCount, unsigned(argumentsCount));
 
-        for(int i = argumentsCount - 1; i >= 0; --i)
-        {
-            arguments[i] = m_stack->back();
-            m_stack->pop_back();
-        }
-
-        Value result = function(*this, m_execctx->lastObject, arguments);
+        Value result = native->call(*this, m_execctx->lastObject, arguments);
 
-        m_stack->push_back(result);
+        m_stack->top -= argumentsCount + 1;
+        m_stack->push(result);
     }
 
     void VirtualMachine::arrayPushElement(Array* array, const Value& newValue)
@@ -1506,86 +2700,253 @@ namespace element
 
     void VirtualMachine::loadMemberFromObject(Object* object, unsigned hash, Value* outValue) const
     {
-        Object::Member member(hash);
+        const Object* current = object;
+
+        while(true)
+        {
+            int slot = current->findSlot(hash);
+
+            if(slot >= 0)// found the value corresponding to this hash
+            {
+                *outValue = current->slots[slot];
+                return;
+            }
+
+            const Value& proto = current->slots[0];
+
+            if(proto.type() != Value::VT_Object ||// it has no proto object
+               proto.object() == object)// or the chain went back to the first object
+            {
+                return;// not found, out value shall stay nil
+            }
+
+            current = proto.object();
+        }
+    }
+
+    void VirtualMachine::objectStoreMember(Object* object, unsigned hash, const Value& newValue)
+    {
+        Object* current = object;
+
+        while(true)
+        {
+            int slot = current->findSlot(hash);
+
+            if(slot >= 0)// found the value corresponding to this hash
+            {
+                current->slots[slot] = newValue;
+                m_memoryman.updateGCRelationship(current, newValue);
+                return;
+            }
+
+            const Value& proto = current->slots[0];
+
+            if(proto.type() != Value::VT_Object ||// it has no proto object
+               proto.object() == object)// or the chain went back to the first object
+            {
+                break;
+            }
+
+            current = proto.object();
+        }
+
+        // not found in the proto chain, create a new one
+        object->addMember(hash, newValue);
+
+        m_memoryman.updateGCRelationship(object, newValue);
+    }
+
+    // Looks for a member like loadMemberFromObject does and describes in the entry
+    // where it was found. Returns the object holding the member or nullptr.
+    static Object* findMemberForCache(Object* object, unsigned hash, InlineCache::Entry* entry, bool* cacheable)
+    {
+        Object* current = object;
+
+        entry->shape = object->shape;
+        entry->newShape = nullptr;
+        entry->depth = 0;
+        entry->slot = 0;
 
-        auto it = std::lower_bound(object->members.begin(), object->members.end(), member);
+        // a dictionary shape changes in place and dies with its object, so it can't be remembered
+        *cacheable = !object->shape->dictionary;
 
-        if(it == object->members.end() || it->hash != hash)
+        while(true)
         {
-            const Value* proto = &object->members[0].value;
+            int slot = current->findSlot(hash);
 
-            while(proto->type == Value::VT_Object &&// it has a proto object
-                  proto->object != object)// and it is not the first object
+            if(slot >= 0)
             {
-                std::vector<Object::Member>& members = proto->object->members;
+                entry->slot = unsigned(slot);
+                return current;
+            }
 
-                auto it = std::lower_bound(members.begin(), members.end(), member);
+            const Value& proto = current->slots[0];
 
-                if(it == members.end() || it->hash != hash)
-                {
-                    proto = &members[0].value;
-                }
-                else// found in one of the proto objects
-                {
-                    *outValue = it->value;
-                    return;
-                }
+            if(proto.type() != Value::VT_Object)
+                return nullptr;
+
+            if(proto.object() == object)
+            {
+                *cacheable = false;
+                return nullptr;
             }
 
-            // not found, out value shall stay nil
+            current = proto.object();
+
+            if(entry->depth == InlineCache::MaxProtoDepth || current->shape->dictionary)
+            {
+                *cacheable = false;
+            }
+            else
+            {
+                entry->protos[entry->depth] = current;
+                entry->protoShapes[entry->depth] = current->shape;
+                ++entry->depth;
+            }
         }
-        else// found the value corresponding to this hash
+    }
+
+    // Follows the proto chain of the object as recorded in the entry.
+    // Returns the last object of the recorded chain or nullptr when the chain differs.
+    static Object* followCachedProtos(const InlineCache::Entry& entry, Object* object)
+    {
+        Object* current = object;
+
+        for(int i = 0; i < entry.depth; ++i)
         {
-            *outValue = it->value;
+            const Value& proto = current->slots[0];
+
+            if(proto.type() != Value::VT_Object || proto.object() != entry.protos[i] || proto.object()->shape != entry.protoShapes[i])
+                return nullptr;
+
+            current = proto.object();
         }
+
+        return current;
     }
 
-    void VirtualMachine::objectStoreMember(Object* object, unsigned hash, const Value& newValue)
+    static void addInlineCacheEntry(InlineCache& cache, unsigned hash, const InlineCache::Entry& entry)
     {
-        Object::Member member(hash);
+        if(cache.hash != hash)
+        {
+            cache.hash = hash;
+            cache.entriesCount = 0;
+        }
 
-        auto it = std::lower_bound(object->members.begin(), object->members.end(), member);
+        if(cache.megamorphic)
+            return;
 
-        if(it == object->members.end() || it->hash != hash)
+        if(cache.entriesCount == InlineCache::MaxEntries)
         {
-            bool found = false;
-            const Value* proto = &object->members[0].value;
+            cache.megamorphic = true;
+            return;
+        }
+
+        cache.entries[cache.entriesCount++] = entry;
+    }
 
-            while(proto->type == Value::VT_Object &&// it has a proto object
-                  proto->object != object)// and it is not the first object
+    void VirtualMachine::cachedLoadMember(InlineCache& cache, Object* object, unsigned hash, Value* outValue)
+    {
+        if(cache.hash == hash)
+        {
+            for(int i = 0; i < cache.entriesCount; ++i)
             {
-                std::vector<Object::Member>& members = proto->object->members;
+                const InlineCache::Entry& entry = cache.entries[i];
+
+                if(entry.shape != object->shape)
+                    continue;
 
-                auto it = std::lower_bound(members.begin(), members.end(), member);
+                const Object* holder = followCachedProtos(entry, object);
 
-                if(it == members.end() || it->hash != hash)
+                if(holder)
                 {
-                    proto = &members[0].value;
+                    ++cache.hits;
+                    *outValue = holder->slots[entry.slot];
+                    return;
                 }
-                else// found in one of the proto objects
+            }
+        }
+
+        ++cache.misses;
+
+        InlineCache::Entry entry;
+        bool cacheable;
+        const Object* holder = findMemberForCache(object, hash, &entry, &cacheable);
+
+        if(!holder)
+            return;// not found, out value shall stay nil
+
+        *outValue = holder->slots[entry.slot];
+
+        if(cacheable)
+            addInlineCacheEntry(cache, hash, entry);
+    }
+
+    void VirtualMachine::cachedStoreMember(InlineCache& cache, Object* object, unsigned hash, const Value& newValue)
+    {
+        if(cache.hash == hash)
+        {
+            for(int i = 0; i < cache.entriesCount; ++i)
+            {
+                const InlineCache::Entry& entry = cache.entries[i];
+
+                if(entry.shape != object->shape)
+                    continue;
+
+                Object* holder = followCachedProtos(entry, object);
+
+                if(!holder)
+                    continue;
+
+                if(entry.newShape)// adding the member, valid only while the chain still ends here
                 {
-                    it->value = newValue;
-                    found = true;
-                    break;
+                    if(holder->slots[0].type() == Value::VT_Object)
+                        continue;
+
+                    ++cache.hits;
+                    object->shape = entry.newShape;
+                    object->slots.push_back(newValue);
+                    m_memoryman.updateGCRelationship(object, newValue);
+                    return;
                 }
+
+                ++cache.hits;
+                holder->slots[entry.slot] = newValue;
+                m_memoryman.updateGCRelationship(holder, newValue);
+                return;
             }
+        }
+
+        ++cache.misses;
+
+        InlineCache::Entry entry;
+        bool cacheable;
+        Object* holder = findMemberForCache(object, hash, &entry, &cacheable);
 
-            if(!found)// create a new one
-                object->members.insert(it, Object::Member(hash, newValue));
+        if(holder)
+        {
+            holder->slots[entry.slot] = newValue;
+            m_memoryman.updateGCRelationship(holder, newValue);
         }
-        else// found the value corresponding to this hash
+        else
         {
-            it->value = newValue;
+            // not found in the proto chain, create a new one
+            object->addMember(hash, newValue);
+            m_memoryman.updateGCRelationship(object, newValue);
+
+            entry.newShape = object->shape;
+            entry.slot = unsigned(object->slots.size() - 1);
+            cacheable = cacheable && !object->shape->dictionary;
         }
 
-        m_memoryman.updateGCRelationship(object, newValue);
+        if(cacheable)
+            addInlineCacheEntry(cache, hash, entry);
     }
 
     bool VirtualMachine::doBinaryOperation(int opCode)
     {
-        unsigned last = m_stack->size() - 1;
-        Value& lhs = m_stack->at(last - 1);
-        Value& rhs = m_stack->at(last);
+        Value& lhs = m_stack->top[-2];
+        Value& rhs = m_stack->top[-1];
         Value result;
 
         switch(opCode)
@@ -1603,27 +2964,34 @@ namespace element
                 {
                     Array* newArray = m_memoryman.makeArray();
                     auto& elements = newArray->elements;
-                    elements.reserve(lhs.array->elements.size() + rhs.array->elements.size());
+                    elements.reserve(lhs.array()->elements.size() + rhs.array()->elements.size());
 
-                    for(const auto& v : lhs.array->elements)
+                    for(const auto& v : lhs.array()->elements)
                         elements.push_back(v);
-                    for(const auto& v : rhs.array->elements)
+                    for(const auto& v : rhs.array()->elements)
                         elements.push_back(v);
 
                     result = newArray;
                 }
                 else if(lhs.isObject() && rhs.isObject())
                 {
-                    Object* newObject = m_memoryman.makeObject();
-                    auto& members = newObject->members;
-                    members.reserve(lhs.object->members.size() + rhs.object->members.size());
+                    // the members of the right object override the ones of the left
+                    // object, the proto is only overridden if it is set on the right
+                    Object* newObject = m_memoryman.makeObject(lhs.object());
 
-                    for(const auto& v : lhs.object->members)
-                        members.push_back(v);
-                    for(const auto& v : rhs.object->members)
-                        members.push_back(v);
+                    if(!rhs.object()->slots[0].isNil())
+                        newObject->slots[0] = rhs.object()->slots[0];
 
-                    std::sort(members.begin(), members.end());
+                    for(unsigned i = 1; i < rhs.object()->membersCount(); ++i)
+                    {
+                        unsigned hash = rhs.object()->memberHash(i);
+                        int slot = newObject->findSlot(hash);
+
+                        if(slot >= 0)
+                            newObject->slots[slot] = rhs.object()->slots[i];
+                        else
+                            newObject->addMember(hash, rhs.object()->slots[i]);
+                    }
 
                     result = newObject;
                 }
@@ -1695,7 +3063,7 @@ namespace element
                 if(lhs.isNumber() && rhs.isNumber())
                 {
                     if(lhs.isFloat())
-                        result = float(std::pow(lhs.asFloat(), rhs.asFloat()));
+                        result = std::pow(lhs.asFloat(), rhs.asFloat());
                     else
                         result = int(std::pow(lhs.toInt(), rhs.asFloat()));
                 }
@@ -1727,7 +3095,7 @@ namespace element
             case OC_Concatenate:
             {
                 if(lhs.isString() && rhs.isString())
-                    result = m_memoryman.makeString(lhs.string->str + rhs.string->str);
+                    result = m_memoryman.makeString(lhs.string()->str + rhs.string()->str);
                 else// anything can be turned into a string
                     result = m_memoryman.makeString(lhs.asString() + rhs.asString());
                 break;
@@ -1749,18 +3117,18 @@ namespace element
                 {
                     result = lhs.asFloat() == rhs.asFloat();
                 }
-                else if(lhs.type == rhs.type)
+                else if(lhs.type() == rhs.type())
                 {
                     if(lhs.isNil())
                         result = true;
                     else if(lhs.isBoolean())
                         result = lhs.asBool() == rhs.asBool();
                     else if(lhs.IsHash())
-                        result = lhs.hash == rhs.hash;
+                        result = lhs.hash() == rhs.hash();
                     else if(lhs.isString() || lhs.isError())
                         result = lhs.asString() == rhs.asString();
                     else
-                        result = lhs.object == rhs.object;// compare any pointers
+                        result = lhs.object() == rhs.object();// compare any pointers
                 }
                 else
                 {
@@ -1779,18 +3147,18 @@ namespace element
                 {
                     result = lhs.asFloat() != rhs.asFloat();
                 }
-                else if(lhs.type == rhs.type)
+                else if(lhs.type() == rhs.type())
                 {
                     if(lhs.isNil())
                         result = false;
                     else if(lhs.isBoolean())
                         result = lhs.asBool() != rhs.asBool();
                     else if(lhs.IsHash())
-                        result = lhs.hash != rhs.hash;
+                        result = lhs.hash() != rhs.hash();
                     else if(lhs.isString() || lhs.isError())
                         result = lhs.asString() != rhs.asString();
                     else
-                        result = lhs.object != rhs.object;// compare any pointers
+                        result = lhs.object() != rhs.object();// compare any pointers
                 }
                 else
                 {
@@ -1868,9 +3236,8 @@ namespace element
             }
         }
 
-        m_stack->pop_back();
-        m_stack->pop_back();
-        m_stack->push_back(result);
+        m_stack->pop();
+        m_stack->back() = result;
 
         return true;
     }
@@ -1907,7 +3274,8 @@ namespace element
 
             while(currentContext)
             {
-                std::deque<StackFrame>& stackFrames = currentContext->stackFrames;
+                std::vector<StackFrame>& stackFrames = currentContext->stackFrames;
+                currentContext->scannedFrames = 0;// unwound without the stack barrier
 
                 while(!stackFrames.empty())
                 {